@@ -51,18 +51,14 @@
 #include "mm.h"
 #include "memlib.h"
 
-/* single word (4) or double word (8) alignment */
-#define ALIGNMENT 8
-
-/* rounds up to the nearest multiple of ALIGNMENT */
-#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~0x7)
-
+/* Block format: 4-byte header/footer words, 8-byte alignment */
+#define MM_WSIZE    4
+#define MM_ALIGNMENT    8
+#include "mm_block.h"
 
 #define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
 
 /* Basic constants and macros */
-#define WSIZE   4
-#define DSIZE   8
 #define CHUNKSIZE   (1<<12)
 
 /* Minimum block size */
@@ -70,24 +66,8 @@
 
 #define MAX(x, y)   ((x) > (y)? (x) : (y))
 
-/* Pack a size and allocated bit into a word */
-#define PACK(size, alloc)   ((size) | (alloc))
-
-/* Read and write a word at address p */
-#define GET(p)  (*(size_t *)(p))
-#define PUT(p, val) (*(size_t *)(p) = val)
-
-/* Given block ptr bp, compute address of its header and footer */
-#define HDRP(bp)    ((void*)(bp) - WSIZE)
-#define FTRP(bp)    ((void*)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
-
-/* Given block ptr bp, compute address of next and previous blocks */
-#define NEXT_BLKP(bp)   ((void*)(bp) + GET_SIZE(((void*)(bp) - WSIZE)))
-#define PREV_BLKP(bp)   ((void*)(bp) - GET_SIZE(((void*)(bp) - DSIZE)))
-
-/* Given header or footer ptr p, compute the size of block n allocated state */
-#define GET_SIZE(p)     (GET(p) & ~0x7)
-#define GET_STATE(p)    (GET(p) & 0x1)
+/* Given header or footer ptr p, compute the allocated state */
+#define GET_STATE(p)    GET_ALLOC(p)
 
 /* Basic pointer to the first block n first freed block */
 void *heap_listp = 0;
@@ -373,18 +353,14 @@ void place(void *bp, size_t asize){
 #include "mm.h"
 #include "memlib.h"
 
-/* single word (4) or double word (8) alignment */
-#define ALIGNMENT 8
-
-/* rounds up to the nearest multiple of ALIGNMENT */
-#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~0x7)
-
+/* Block format: 4-byte header/footer words, 8-byte alignment */
+#define MM_WSIZE    4
+#define MM_ALIGNMENT    8
+#include "mm_block.h"
 
 #define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
 
 /* Basic constants and macros */
-#define WSIZE   4
-#define DSIZE   8
 #define CHUNKSIZE   (1<<12)
 
 /* Minimum block size */
@@ -392,24 +368,8 @@ void place(void *bp, size_t asize){
 
 #define MAX(x, y)   ((x) > (y)? (x) : (y))
 
-/* Pack a size and allocated bit into a word */
-#define PACK(size, alloc)   ((size) | (alloc))
-
-/* Read and write a word at address p */
-#define GET(p)  (*(size_t *)(p))
-#define PUT(p, val) (*(size_t *)(p) = val)
-
-/* Given block ptr bp, compute address of its header and footer */
-#define HDRP(bp)    ((void*)(bp) - WSIZE)
-#define FTRP(bp)    ((void*)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
-
-/* Given block ptr bp, compute address of next and previous blocks */
-#define NEXT_BLKP(bp)   ((void*)(bp) + GET_SIZE(((void*)(bp) - WSIZE)))
-#define PREV_BLKP(bp)   ((void*)(bp) - GET_SIZE(((void*)(bp) - DSIZE)))
-
-/* Given header or footer ptr p, compute the size of block n allocated state */
-#define GET_SIZE(p)     (GET(p) & ~0x7)
-#define GET_STATE(p)    (GET(p) & 0x1)
+/* Given header or footer ptr p, compute the allocated state */
+#define GET_STATE(p)    GET_ALLOC(p)
 
 /* Basic pointer to the first block n first freed block */
 void *heap_listp = 0;
@@ -695,18 +655,14 @@ void place(void *bp, size_t asize){
 #include "mm.h"
 #include "memlib.h"
 
-/* single word (4) or double word (8) alignment */
-#define ALIGNMENT 8
-
-/* rounds up to the nearest multiple of ALIGNMENT */
-#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~0x7)
-
+/* Block format: 4-byte header/footer words, 8-byte alignment */
+#define MM_WSIZE    4
+#define MM_ALIGNMENT    8
+#include "mm_block.h"
 
 #define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
 
 /* Basic constants and macros */
-#define WSIZE   4
-#define DSIZE   8
 #define CHUNKSIZE   (1<<12)
 
 /* Minimum block size */
@@ -714,24 +670,8 @@ void place(void *bp, size_t asize){
 
 #define MAX(x, y)   ((x) > (y)? (x) : (y))
 
-/* Pack a size and allocated bit into a word */
-#define PACK(size, alloc)   ((size) | (alloc))
-
-/* Read and write a word at address p */
-#define GET(p)  (*(size_t *)(p))
-#define PUT(p, val) (*(size_t *)(p) = val)
-
-/* Given block ptr bp, compute address of its header and footer */
-#define HDRP(bp)    ((void*)(bp) - WSIZE)
-#define FTRP(bp)    ((void*)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
-
-/* Given block ptr bp, compute address of next and previous blocks */
-#define NEXT_BLKP(bp)   ((void*)(bp) + GET_SIZE(((void*)(bp) - WSIZE)))
-#define PREV_BLKP(bp)   ((void*)(bp) - GET_SIZE(((void*)(bp) - DSIZE)))
-
-/* Given header or footer ptr p, compute the size of block n allocated state */
-#define GET_SIZE(p)     (GET(p) & ~0x7)
-#define GET_STATE(p)    (GET(p) & 0x1)
+/* Given header or footer ptr p, compute the allocated state */
+#define GET_STATE(p)    GET_ALLOC(p)
 
 /* Basic pointer to the first block n first freed block */
 void *heap_listp = 0;
@@ -1017,18 +957,14 @@ void place(void *bp, size_t asize){
 #include "mm.h"
 #include "memlib.h"
 
-/* single word (4) or double word (8) alignment */
-#define ALIGNMENT 8
-
-/* rounds up to the nearest multiple of ALIGNMENT */
-#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~0x7)
-
+/* Block format: 4-byte header/footer words, 8-byte alignment */
+#define MM_WSIZE    4
+#define MM_ALIGNMENT    8
+#include "mm_block.h"
 
 #define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
 
 /* Basic constants and macros */
-#define WSIZE   4
-#define DSIZE   8
 #define CHUNKSIZE   (1<<12)
 
 /* Minimum block size */
@@ -1036,24 +972,8 @@ void place(void *bp, size_t asize){
 
 #define MAX(x, y)   ((x) > (y)? (x) : (y))
 
-/* Pack a size and allocated bit into a word */
-#define PACK(size, alloc)   ((size) | (alloc))
-
-/* Read and write a word at address p */
-#define GET(p)  (*(size_t *)(p))
-#define PUT(p, val) (*(size_t *)(p) = val)
-
-/* Given block ptr bp, compute address of its header and footer */
-#define HDRP(bp)    ((void*)(bp) - WSIZE)
-#define FTRP(bp)    ((void*)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
-
-/* Given block ptr bp, compute address of next and previous blocks */
-#define NEXT_BLKP(bp)   ((void*)(bp) + GET_SIZE(((void*)(bp) - WSIZE)))
-#define PREV_BLKP(bp)   ((void*)(bp) - GET_SIZE(((void*)(bp) - DSIZE)))
-
-/* Given header or footer ptr p, compute the size of block n allocated state */
-#define GET_SIZE(p)     (GET(p) & ~0x7)
-#define GET_STATE(p)    (GET(p) & 0x1)
+/* Given header or footer ptr p, compute the allocated state */
+#define GET_STATE(p)    GET_ALLOC(p)
 
 /* Basic pointer to the first block n first freed block */
 void *heap_listp = 0;
@@ -1339,18 +1259,14 @@ void place(void *bp, size_t asize){
 #include "mm.h"
 #include "memlib.h"
 
-/* single word (4) or double word (8) alignment */
-#define ALIGNMENT 8
-
-/* rounds up to the nearest multiple of ALIGNMENT */
-#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~0x7)
-
+/* Block format: 4-byte header/footer words, 8-byte alignment */
+#define MM_WSIZE    4
+#define MM_ALIGNMENT    8
+#include "mm_block.h"
 
 #define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
 
 /* Basic constants and macros */
-#define WSIZE   4
-#define DSIZE   8
 #define CHUNKSIZE   (1<<12)
 
 /* Minimum block size */
@@ -1358,24 +1274,8 @@ void place(void *bp, size_t asize){
 
 #define MAX(x, y)   ((x) > (y)? (x) : (y))
 
-/* Pack a size and allocated bit into a word */
-#define PACK(size, alloc)   ((size) | (alloc))
-
-/* Read and write a word at address p */
-#define GET(p)  (*(size_t *)(p))
-#define PUT(p, val) (*(size_t *)(p) = val)
-
-/* Given block ptr bp, compute address of its header and footer */
-#define HDRP(bp)    ((void*)(bp) - WSIZE)
-#define FTRP(bp)    ((void*)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
-
-/* Given block ptr bp, compute address of next and previous blocks */
-#define NEXT_BLKP(bp)   ((void*)(bp) + GET_SIZE(((void*)(bp) - WSIZE)))
-#define PREV_BLKP(bp)   ((void*)(bp) - GET_SIZE(((void*)(bp) - DSIZE)))
-
-/* Given header or footer ptr p, compute the size of block n allocated state */
-#define GET_SIZE(p)     (GET(p) & ~0x7)
-#define GET_STATE(p)    (GET(p) & 0x1)
+/* Given header or footer ptr p, compute the allocated state */
+#define GET_STATE(p)    GET_ALLOC(p)
 
 /* Basic pointer to the first block n first freed block */
 void *heap_listp = 0;
@@ -1661,18 +1561,14 @@ void place(void *bp, size_t asize){
 #include "mm.h"
 #include "memlib.h"
 
-/* single word (4) or double word (8) alignment */
-#define ALIGNMENT 8
-
-/* rounds up to the nearest multiple of ALIGNMENT */
-#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~0x7)
-
+/* Block format: 4-byte header/footer words, 8-byte alignment */
+#define MM_WSIZE    4
+#define MM_ALIGNMENT    8
+#include "mm_block.h"
 
 #define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
 
 /* Basic constants and macros */
-#define WSIZE   4
-#define DSIZE   8
 #define CHUNKSIZE   (1<<12)
 
 /* Minimum block size */
@@ -1680,24 +1576,8 @@ void place(void *bp, size_t asize){
 
 #define MAX(x, y)   ((x) > (y)? (x) : (y))
 
-/* Pack a size and allocated bit into a word */
-#define PACK(size, alloc)   ((size) | (alloc))
-
-/* Read and write a word at address p */
-#define GET(p)  (*(size_t *)(p))
-#define PUT(p, val) (*(size_t *)(p) = val)
-
-/* Given block ptr bp, compute address of its header and footer */
-#define HDRP(bp)    ((void*)(bp) - WSIZE)
-#define FTRP(bp)    ((void*)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
-
-/* Given block ptr bp, compute address of next and previous blocks */
-#define NEXT_BLKP(bp)   ((void*)(bp) + GET_SIZE(((void*)(bp) - WSIZE)))
-#define PREV_BLKP(bp)   ((void*)(bp) - GET_SIZE(((void*)(bp) - DSIZE)))
-
-/* Given header or footer ptr p, compute the size of block n allocated state */
-#define GET_SIZE(p)     (GET(p) & ~0x7)
-#define GET_STATE(p)    (GET(p) & 0x1)
+/* Given header or footer ptr p, compute the allocated state */
+#define GET_STATE(p)    GET_ALLOC(p)
 
 /* Basic pointer to the first block n first freed block */
 void *heap_listp = 0;
@@ -1983,18 +1863,14 @@ void place(void *bp, size_t asize){
 #include "mm.h"
 #include "memlib.h"
 
-/* single word (4) or double word (8) alignment */
-#define ALIGNMENT 8
-
-/* rounds up to the nearest multiple of ALIGNMENT */
-#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~0x7)
-
+/* Block format: 4-byte header/footer words, 8-byte alignment */
+#define MM_WSIZE    4
+#define MM_ALIGNMENT    8
+#include "mm_block.h"
 
 #define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
 
 /* Basic constants and macros */
-#define WSIZE   4
-#define DSIZE   8
 #define CHUNKSIZE   (1<<12)
 
 /* Minimum block size */
@@ -2002,24 +1878,8 @@ void place(void *bp, size_t asize){
 
 #define MAX(x, y)   ((x) > (y)? (x) : (y))
 
-/* Pack a size and allocated bit into a word */
-#define PACK(size, alloc)   ((size) | (alloc))
-
-/* Read and write a word at address p */
-#define GET(p)  (*(size_t *)(p))
-#define PUT(p, val) (*(size_t *)(p) = val)
-
-/* Given block ptr bp, compute address of its header and footer */
-#define HDRP(bp)    ((void*)(bp) - WSIZE)
-#define FTRP(bp)    ((void*)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
-
-/* Given block ptr bp, compute address of next and previous blocks */
-#define NEXT_BLKP(bp)   ((void*)(bp) + GET_SIZE(((void*)(bp) - WSIZE)))
-#define PREV_BLKP(bp)   ((void*)(bp) - GET_SIZE(((void*)(bp) - DSIZE)))
-
-/* Given header or footer ptr p, compute the size of block n allocated state */
-#define GET_SIZE(p)     (GET(p) & ~0x7)
-#define GET_STATE(p)    (GET(p) & 0x1)
+/* Given header or footer ptr p, compute the allocated state */
+#define GET_STATE(p)    GET_ALLOC(p)
 
 /* Basic pointer to the first block n first freed block */
 void *heap_listp = 0;
@@ -2305,18 +2165,14 @@ void place(void *bp, size_t asize){
 #include "mm.h"
 #include "memlib.h"
 
-/* single word (4) or double word (8) alignment */
-#define ALIGNMENT 8
-
-/* rounds up to the nearest multiple of ALIGNMENT */
-#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~0x7)
-
+/* Block format: 4-byte header/footer words, 8-byte alignment */
+#define MM_WSIZE    4
+#define MM_ALIGNMENT    8
+#include "mm_block.h"
 
 #define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
 
 /* Basic constants and macros */
-#define WSIZE   4
-#define DSIZE   8
 #define CHUNKSIZE   (1<<12)
 
 /* Minimum block size */
@@ -2324,24 +2180,8 @@ void place(void *bp, size_t asize){
 
 #define MAX(x, y)   ((x) > (y)? (x) : (y))
 
-/* Pack a size and allocated bit into a word */
-#define PACK(size, alloc)   ((size) | (alloc))
-
-/* Read and write a word at address p */
-#define GET(p)  (*(size_t *)(p))
-#define PUT(p, val) (*(size_t *)(p) = val)
-
-/* Given block ptr bp, compute address of its header and footer */
-#define HDRP(bp)    ((void*)(bp) - WSIZE)
-#define FTRP(bp)    ((void*)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
-
-/* Given block ptr bp, compute address of next and previous blocks */
-#define NEXT_BLKP(bp)   ((void*)(bp) + GET_SIZE(((void*)(bp) - WSIZE)))
-#define PREV_BLKP(bp)   ((void*)(bp) - GET_SIZE(((void*)(bp) - DSIZE)))
-
-/* Given header or footer ptr p, compute the size of block n allocated state */
-#define GET_SIZE(p)     (GET(p) & ~0x7)
-#define GET_STATE(p)    (GET(p) & 0x1)
+/* Given header or footer ptr p, compute the allocated state */
+#define GET_STATE(p)    GET_ALLOC(p)
 
 /* Basic pointer to the first block n first freed block */
 void *heap_listp = 0;
@@ -0,0 +1,916 @@
+/*
+ * mm_bench.c - synthetic allocator benchmarks
+ *
+ * Complements trace replay in mdriver with workloads that stress one
+ * thing at a time:
+ *
+ *  churn     fixed-size blocks, free a random live one, allocate again
+ *  powerlaw  sizes drawn from a power law (many small, few large)
+ *  prodcon   producer threads allocate, consumer threads free
+ *  realloc   buffers grown by doubling with realloc
+ *  mixed     short-lived request blocks around long-lived cache entries
+ *  fork      threads churn while the main thread forks children that
+ *            allocate; a child that hangs or dies fails the run
+ *
+ * Link it against any allocator that has the mm_* interface, exactly
+ * like mdriver (mm.o memlib.o), or build with -DBENCH_LIBC to measure
+ * glibc malloc as the baseline:
+ *
+ *  gcc -O2 -DDRIVER -DBENCH_COPY mm_bench.c mm_core.c mm_copy.c memlib.c -lpthread
+ *  gcc -O2 -DDRIVER -DMM_THREADS -DBENCH_THREADSAFE \
+ *          mm_bench.c mm_core.c mm_copy.c mm_region.c memlib.c -lpthread
+ *  gcc -O2 -DBENCH_LIBC -DBENCH_THREADSAFE mm_bench.c -lpthread
+ *
+ * With -DBENCH_HINTS the mixed workload tells mm_malloc_hint which
+ * blocks are long-lived; comparing heap_bytes with and without it shows
+ * what lifetime pools (-DMM_HINTS) buy in peak heap size.
+ *
+ * With -DBENCH_COPY, for builds that link mm_copy.o, -c replaces the
+ * workloads by a copy sweep from 4 KiB to 64 MiB that times glibc
+ * memcpy against mm_memcpy (mm_copy.c), the copy realloc uses; the
+ * allocator column then names the copy routine.
+ *
+ * -p <lib> replaces them by a smoke run of a few standard tools over a
+ * generated file of -n/10 lines, once as they are and once with lib
+ * (mm_preload.so) in LD_PRELOAD. Both runs have to exit 0 and print the
+ * same bytes; heap_bytes is the tool's peak RSS.
+ *
+ * Allocators that are not thread safe are driven under one global lock
+ * in the threaded workloads unless BENCH_THREADSAFE is defined.
+ *
+ * Every run prints one record per workload, as CSV (default) or JSON
+ * lines (-j), so results can be appended to a file and compared later.
+ */
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#ifdef BENCH_LIBC
+#define ALLOC_NAME      "glibc"
+#define ALLOC_MALLOC    malloc
+#define ALLOC_FREE      free
+#define ALLOC_REALLOC   realloc
+#else
+#include "mm.h"
+#include "memlib.h"
+#define ALLOC_NAME      "mm"
+#define ALLOC_MALLOC    mm_malloc
+#define ALLOC_FREE      mm_free
+#define ALLOC_REALLOC   mm_realloc
+#endif
+
+#ifdef BENCH_COPY
+#include "mm_copy.h"
+#endif
+#include "mm_ext.h"
+
+#ifdef BENCH_HINTS
+#define ALLOC_MALLOC_HINT(size, hint)   mm_malloc_hint((size), (hint))
+#else
+#define ALLOC_MALLOC_HINT(size, hint)   ALLOC_MALLOC(size)
+#endif
+
+#ifdef BENCH_THREADSAFE
+#define THREADSAFE      1
+#else
+#define THREADSAFE      0
+#endif
+
+#define MAXTHREADS      64
+#define QUEUE_SIZE      1024    /* producer/consumer ring, power of two */
+#define MAX_LIVE        (1<<16) /* slots for live blocks per thread */
+#define FORK_OPS        1000    /* allocations per fork in the fork workload */
+#define FORK_TIMEOUT    5       /* seconds before a child counts as hung */
+#define COPY_MIN        ((size_t)4 << 10)   /* copy sweep range (bytes) */
+#define COPY_MAX        ((size_t)64 << 20)
+
+/* benchmark parameters, set from the command line */
+struct config {
+    const char *name;       /* allocator label in the output */
+    long ops;               /* allocations per workload */
+    int threads;            /* threads for prodcon (split evenly) and fork */
+    int live;               /* live blocks kept by churn and powerlaw */
+    size_t size;            /* churn block size (bytes) */
+    size_t max_size;        /* largest powerlaw block (bytes) */
+    size_t max_realloc;     /* realloc buffers stop growing here (bytes) */
+    int json;               /* JSON lines instead of CSV */
+    int copy;               /* copy sweep instead of the workloads (BENCH_COPY) */
+    const char *preload;    /* smoke run this library instead, or NULL */
+};
+
+/* one record of output */
+struct result {
+    const char *workload;
+    int threads;
+    long ops;
+    double secs;
+    size_t heap;            /* heap size at the end, 0 if unknown */
+};
+
+typedef void (*workload_fn)(const struct config *, struct result *);
+
+static pthread_mutex_t alloc_lock = PTHREAD_MUTEX_INITIALIZER;
+static int serialize;       /* take alloc_lock around every call */
+
+/*
+ * b_malloc, b_malloc_hint, b_free, b_realloc - call the allocator
+ *                                              under test
+ */
+static inline void *b_malloc(size_t size)
+{
+    void *p;
+
+    if (serialize)
+        pthread_mutex_lock(&alloc_lock);
+    p = ALLOC_MALLOC(size);
+    if (serialize)
+        pthread_mutex_unlock(&alloc_lock);
+    if (p == NULL) {
+        fprintf(stderr, "mm_bench: out of memory at %zu bytes\n", size);
+        exit(1);
+    }
+    return p;
+}
+
+static inline void *b_malloc_hint(size_t size, int hint)
+{
+    void *p;
+
+    (void)hint;
+    if (serialize)
+        pthread_mutex_lock(&alloc_lock);
+    p = ALLOC_MALLOC_HINT(size, hint);
+    if (serialize)
+        pthread_mutex_unlock(&alloc_lock);
+    if (p == NULL) {
+        fprintf(stderr, "mm_bench: out of memory at %zu bytes\n", size);
+        exit(1);
+    }
+    return p;
+}
+
+static inline void b_free(void *p)
+{
+    if (serialize)
+        pthread_mutex_lock(&alloc_lock);
+    ALLOC_FREE(p);
+    if (serialize)
+        pthread_mutex_unlock(&alloc_lock);
+}
+
+static inline void *b_realloc(void *p, size_t size)
+{
+    if (serialize)
+        pthread_mutex_lock(&alloc_lock);
+    p = ALLOC_REALLOC(p, size);
+    if (serialize)
+        pthread_mutex_unlock(&alloc_lock);
+    if (p == NULL) {
+        fprintf(stderr, "mm_bench: out of memory at %zu bytes\n", size);
+        exit(1);
+    }
+    return p;
+}
+
+/* touch both ends so the block is really used, like a caller would */
+static inline void touch(void *p, size_t size)
+{
+    ((volatile char *)p)[0] = 1;
+    ((volatile char *)p)[size - 1] = 1;
+}
+
+/*
+ * rnd - xorshift64, one state per thread, deterministic for a seed
+ */
+static inline uint64_t rnd(uint64_t *state)
+{
+    uint64_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+/*
+ * powerlaw_size - size in [16, max] with P(size > s) ~ 1/s
+ */
+static size_t powerlaw_size(uint64_t *state, size_t max)
+{
+    double u = (rnd(state) >> 11) * (1.0 / 9007199254740992.0);
+    size_t size = (size_t)(16.0 / (1.0 - u * (1.0 - 16.0 / max)));
+
+    return size > max ? max : size;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * replace_random - keep cfg->live blocks, replacing a random one per op
+ */
+static void replace_random(const struct config *cfg, struct result *res,
+                           int powerlaw)
+{
+    void **slot = calloc(cfg->live, sizeof(void *));
+    uint64_t state = 88172645463325252ULL;
+    double start = now();
+
+    for (long i = 0; i < cfg->ops; i++) {
+        int k = rnd(&state) % cfg->live;
+        size_t size = powerlaw ? powerlaw_size(&state, cfg->max_size) : cfg->size;
+
+        if (slot[k] != NULL)
+            b_free(slot[k]);
+        slot[k] = b_malloc(size);
+        touch(slot[k], size);
+    }
+    for (int k = 0; k < cfg->live; k++)
+        if (slot[k] != NULL)
+            b_free(slot[k]);
+
+    res->secs = now() - start;
+    res->ops = cfg->ops;
+    free(slot);
+}
+
+static void bench_churn(const struct config *cfg, struct result *res)
+{
+    replace_random(cfg, res, 0);
+}
+
+static void bench_powerlaw(const struct config *cfg, struct result *res)
+{
+    replace_random(cfg, res, 1);
+}
+
+/*
+ * bench_realloc - grow up to 16 buffers by doubling, round robin, so
+ *                 each realloc has neighbours that may block in-place growth
+ */
+static void bench_realloc(const struct config *cfg, struct result *res)
+{
+    int n = cfg->live < 16 ? cfg->live : 16;
+    void **buf = calloc(n, sizeof(void *));
+    size_t *len = calloc(n, sizeof(size_t));
+    double start = now();
+    long ops = 0;
+
+    while (ops < cfg->ops) {
+        for (int k = 0; k < n && ops < cfg->ops; k++, ops++) {
+            if (len[k] == 0 || len[k] >= cfg->max_realloc) {
+                if (buf[k] != NULL)
+                    b_free(buf[k]);
+                len[k] = 16;
+                buf[k] = b_malloc(len[k]);
+            } else {
+                len[k] *= 2;
+                buf[k] = b_realloc(buf[k], len[k]);
+            }
+            touch(buf[k], len[k]);
+        }
+    }
+    for (int k = 0; k < n; k++)
+        if (buf[k] != NULL)
+            b_free(buf[k]);
+
+    res->secs = now() - start;
+    res->ops = ops;
+    free(buf);
+    free(len);
+}
+
+/*
+ * bench_mixed - requests that allocate a burst of short-lived blocks
+ *               and free them at the end, one in 16 of them instead a
+ *               cache entry that replaces the oldest of cfg->live
+ */
+static void bench_mixed(const struct config *cfg, struct result *res)
+{
+    void **cache = calloc(cfg->live, sizeof(void *));
+    void *req[32];
+    uint64_t state = 0x2545f4914f6cdd1dULL;
+    double start = now();
+    long ops = 0;
+    int next = 0;
+
+    while (ops < cfg->ops) {
+        int n = 1 + rnd(&state) % 32;
+        int k;
+
+        for (k = 0; k < n && ops < cfg->ops; k++, ops++) {
+            size_t size = powerlaw_size(&state, cfg->max_size);
+
+            req[k] = NULL;
+            if (rnd(&state) % 16 == 0) {
+                if (cache[next] != NULL)
+                    b_free(cache[next]);
+                cache[next] = b_malloc_hint(size, MM_HINT_LONG);
+                touch(cache[next], size);
+                next = (next + 1) % cfg->live;
+            } else {
+                req[k] = b_malloc_hint(size, MM_HINT_SHORT);
+                touch(req[k], size);
+            }
+        }
+        while (k-- > 0)
+            if (req[k] != NULL)
+                b_free(req[k]);
+    }
+    for (int i = 0; i < cfg->live; i++)
+        if (cache[i] != NULL)
+            b_free(cache[i]);
+
+    res->secs = now() - start;
+    res->ops = ops;
+    free(cache);
+}
+
+/* bounded ring shared by producers and consumers */
+struct queue {
+    void *item[QUEUE_SIZE];
+    long head, tail;        /* head: next to pop, tail: next to push */
+    long remaining;         /* items consumers still have to take */
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty, not_full;
+};
+
+struct prodcon_arg {
+    const struct config *cfg;
+    struct queue *q;
+    long ops;               /* items this producer makes */
+    uint64_t seed;
+};
+
+static void *producer(void *vargp)
+{
+    struct prodcon_arg *arg = vargp;
+    struct queue *q = arg->q;
+    uint64_t state = arg->seed;
+
+    for (long i = 0; i < arg->ops; i++) {
+        size_t size = 16 + rnd(&state) % 496;
+        void *p = b_malloc(size);
+
+        touch(p, size);
+        pthread_mutex_lock(&q->lock);
+        while (q->tail - q->head == QUEUE_SIZE)
+            pthread_cond_wait(&q->not_full, &q->lock);
+        q->item[q->tail++ % QUEUE_SIZE] = p;
+        pthread_cond_signal(&q->not_empty);
+        pthread_mutex_unlock(&q->lock);
+    }
+    return NULL;
+}
+
+static void *consumer(void *vargp)
+{
+    struct queue *q = ((struct prodcon_arg *)vargp)->q;
+    void *p;
+
+    for (;;) {
+        pthread_mutex_lock(&q->lock);
+        while (q->tail == q->head && q->remaining > 0)
+            pthread_cond_wait(&q->not_empty, &q->lock);
+        if (q->remaining == 0) {
+            pthread_mutex_unlock(&q->lock);
+            return NULL;
+        }
+        p = q->item[q->head++ % QUEUE_SIZE];
+        if (--q->remaining == 0)
+            pthread_cond_broadcast(&q->not_empty);
+        pthread_cond_signal(&q->not_full);
+        pthread_mutex_unlock(&q->lock);
+        b_free(p);
+    }
+}
+
+/*
+ * bench_prodcon - every block is freed by a different thread than the
+ *                 one that allocated it (the proxy's main_args pattern)
+ */
+static void bench_prodcon(const struct config *cfg, struct result *res)
+{
+    int producers = cfg->threads > 1 ? cfg->threads / 2 : 1;
+    int consumers = cfg->threads > 1 ? cfg->threads - producers : 1;
+    pthread_t tid[MAXTHREADS];
+    struct prodcon_arg arg[MAXTHREADS];
+    struct queue q;
+    double start;
+    int i;
+
+    memset(&q, 0, sizeof(q));
+    q.remaining = cfg->ops / producers * producers;
+    pthread_mutex_init(&q.lock, NULL);
+    pthread_cond_init(&q.not_empty, NULL);
+    pthread_cond_init(&q.not_full, NULL);
+    serialize = !THREADSAFE;
+
+    start = now();
+    for (i = 0; i < producers + consumers; i++) {
+        arg[i].cfg = cfg;
+        arg[i].q = &q;
+        arg[i].ops = cfg->ops / producers;
+        arg[i].seed = 0x9e3779b97f4a7c15ULL * (i + 1);
+        pthread_create(&tid[i], NULL, i < producers ? producer : consumer, &arg[i]);
+    }
+    for (i = 0; i < producers + consumers; i++)
+        pthread_join(tid[i], NULL);
+    res->secs = now() - start;
+    res->ops = q.head;
+    res->threads = producers + consumers;
+
+    serialize = 0;
+    pthread_mutex_destroy(&q.lock);
+    pthread_cond_destroy(&q.not_empty);
+    pthread_cond_destroy(&q.not_full);
+}
+
+struct fork_arg {
+    int *stop;
+    uint64_t seed;
+};
+
+static void *fork_churn(void *vargp)
+{
+    struct fork_arg *arg = vargp;
+    uint64_t state = arg->seed;
+    void *slot[64] = { NULL };
+
+    while (!__atomic_load_n(arg->stop, __ATOMIC_RELAXED)) {
+        int k = rnd(&state) % 64;
+        size_t size = powerlaw_size(&state, 4096);
+
+        if (slot[k] != NULL)
+            b_free(slot[k]);
+        slot[k] = b_malloc(size);
+        touch(slot[k], size);
+    }
+    for (int k = 0; k < 64; k++)
+        if (slot[k] != NULL)
+            b_free(slot[k]);
+    return NULL;
+}
+
+/*
+ * fork_lock, fork_unlock - hold alloc_lock across fork, so that a
+ *              serialized allocator is forked between calls, never
+ *              halfway through one
+ */
+static void fork_lock(void)
+{
+    pthread_mutex_lock(&alloc_lock);
+}
+
+static void fork_unlock(void)
+{
+    pthread_mutex_unlock(&alloc_lock);
+}
+
+static void fork_handlers(void)
+{
+    pthread_atfork(fork_lock, fork_unlock, fork_unlock);
+}
+
+/*
+ * fork_child - allocate in the child, under an alarm in case fork left
+ *              a lock held by a thread the child does not have
+ */
+static void fork_child(void)
+{
+    uint64_t state = getpid();
+    void *p;
+
+    alarm(FORK_TIMEOUT);
+    for (int i = 0; i < FORK_OPS; i++) {
+        size_t size = powerlaw_size(&state, 4096);
+
+        p = b_malloc(size);
+        touch(p, size);
+        b_free(p);
+    }
+    _exit(0);
+}
+
+/*
+ * bench_fork - fork cfg->ops / FORK_OPS times while cfg->threads
+ *              threads are inside the allocator
+ */
+static void bench_fork(const struct config *cfg, struct result *res)
+{
+    long forks = cfg->ops / FORK_OPS > 0 ? cfg->ops / FORK_OPS : 1;
+    pthread_t tid[MAXTHREADS];
+    struct fork_arg arg[MAXTHREADS];
+    int stop = 0;
+    double start;
+    int i, status = 0;
+    pid_t pid;
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+    pthread_once(&once, fork_handlers);
+    serialize = !THREADSAFE;
+    for (i = 0; i < cfg->threads; i++) {
+        arg[i].stop = &stop;
+        arg[i].seed = 0x9e3779b97f4a7c15ULL * (i + 1);
+        pthread_create(&tid[i], NULL, fork_churn, &arg[i]);
+    }
+
+    start = now();
+    for (long n = 0; n < forks; n++) {
+        if ((pid = fork()) < 0) {
+            perror("mm_bench: fork");
+            exit(1);
+        }
+        if (pid == 0)
+            fork_child();
+        if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+            WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "mm_bench: fork child %ld %s\n", n,
+                    WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM ?
+                    "hung" : "failed");
+            exit(1);
+        }
+    }
+    res->secs = now() - start;
+
+    __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+    for (i = 0; i < cfg->threads; i++)
+        pthread_join(tid[i], NULL);
+    serialize = 0;
+
+    res->ops = forks * FORK_OPS;
+    res->threads = cfg->threads + 1;
+}
+
+static const struct {
+    const char *name;
+    workload_fn fn;
+} workloads[] = {
+    { "churn",    bench_churn },
+    { "powerlaw", bench_powerlaw },
+    { "prodcon",  bench_prodcon },
+    { "realloc",  bench_realloc },
+    { "mixed",    bench_mixed },
+    { "fork",     bench_fork },
+};
+
+#define NUM_WORKLOADS   (int)(sizeof(workloads) / sizeof(workloads[0]))
+
+/*
+ * reset_allocator - fresh heap before every workload, as mdriver does
+ */
+static void reset_allocator(void)
+{
+#ifndef BENCH_LIBC
+    mem_reset_brk();
+    if (mm_init() < 0) {
+        fprintf(stderr, "mm_bench: mm_init failed\n");
+        exit(1);
+    }
+#endif
+}
+
+#ifndef BENCH_LIBC
+/*
+ * mm_heapsize - memlib heap size, for allocators that do not define
+ *               it; mm_core.c does, and counts its regions as well
+ */
+size_t __attribute__((weak)) mm_heapsize(void)
+{
+    return mem_heapsize();
+}
+#endif
+
+static size_t heap_size(void)
+{
+#ifdef BENCH_LIBC
+    return 0;
+#else
+    return mm_heapsize();
+#endif
+}
+
+static void print_result(const struct config *cfg, const struct result *res)
+{
+    double nsop = res->ops ? res->secs * 1e9 / res->ops : 0;
+    double mops = res->secs > 0 ? res->ops / res->secs / 1e6 : 0;
+
+    if (cfg->json)
+        printf("{\"allocator\":\"%s\",\"workload\":\"%s\",\"threads\":%d,"
+               "\"ops\":%ld,\"secs\":%.6f,\"mops\":%.3f,\"ns_per_op\":%.1f,"
+               "\"heap_bytes\":%zu}\n",
+               cfg->name, res->workload, res->threads, res->ops, res->secs,
+               mops, nsop, res->heap);
+    else
+        printf("%s,%s,%d,%ld,%.6f,%.3f,%.1f,%zu\n",
+               cfg->name, res->workload, res->threads, res->ops, res->secs,
+               mops, nsop, res->heap);
+    fflush(stdout);
+}
+
+#ifdef BENCH_COPY
+/*
+ * copy_sweep - time each copy routine at sizes from COPY_MIN to COPY_MAX,
+ *              copying about cfg->ops * 256 bytes per size
+ */
+static void copy_sweep(const struct config *cfg)
+{
+    static const struct {
+        const char *name;
+        void *(*fn)(void *, const void *, size_t);
+    } copiers[] = {
+        { "memcpy",    memcpy },
+        { "mm_memcpy", mm_memcpy },
+    };
+    char *src = malloc(COPY_MAX), *dst = malloc(COPY_MAX);
+    char workload[32];
+
+    if (src == NULL || dst == NULL) {
+        fprintf(stderr, "mm_bench: out of memory for the copy buffers\n");
+        exit(1);
+    }
+    /* fault both buffers in, the sweep should not time page faults */
+    memset(src, 1, COPY_MAX);
+    memset(dst, 0, COPY_MAX);
+
+    for (size_t size = COPY_MIN; size <= COPY_MAX; size *= 4) {
+        long reps = cfg->ops * 256 / size;
+
+        if (reps < 16)
+            reps = 16;
+        snprintf(workload, sizeof(workload), "copy_%zuK", size >> 10);
+        for (size_t i = 0; i < sizeof(copiers) / sizeof(copiers[0]); i++) {
+            struct config c = *cfg;
+            struct result res = { workload, 1, reps, 0, 0 };
+            double start;
+
+            copiers[i].fn(dst, src, size);      /* warm up */
+            start = now();
+            for (long r = 0; r < reps; r++)
+                copiers[i].fn(dst, src, size);
+            res.secs = now() - start;
+            c.name = copiers[i].name;
+            print_result(&c, &res);
+        }
+    }
+    free(src);
+    free(dst);
+}
+#endif /* def BENCH_COPY */
+
+static void usage(char *prog)
+{
+    fprintf(stderr, "Usage: %s [-chj] [-a <name>] [-n <ops>] [-t <threads>] "
+            "[-l <live>] [-s <size>] [-m <max>] [-p <lib>] [-w <workload>]...\n",
+            prog);
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-a <name>     Allocator label in the output (default %s).\n", ALLOC_NAME);
+#ifdef BENCH_COPY
+    fprintf(stderr, "\t-c            Copy sweep, memcpy against mm_memcpy.\n");
+#endif
+    fprintf(stderr, "\t-h            Print this message.\n");
+    fprintf(stderr, "\t-j            JSON lines instead of CSV.\n");
+    fprintf(stderr, "\t-l <live>     Live blocks for churn/powerlaw, cache entries for mixed (default 4096).\n");
+    fprintf(stderr, "\t-m <max>      Largest powerlaw/mixed size, realloc cap is 64x (default 4096).\n");
+    fprintf(stderr, "\t-n <ops>      Allocations per workload (default 1000000).\n");
+    fprintf(stderr, "\t-p <lib>      Smoke run of standard tools under LD_PRELOAD=lib.\n");
+    fprintf(stderr, "\t-s <size>     Churn block size (default 64).\n");
+    fprintf(stderr, "\t-t <threads>  Threads for prodcon and fork (default 2).\n");
+    fprintf(stderr, "\t-w <workload> churn, powerlaw, prodcon, realloc, mixed or fork; repeatable (default all).\n");
+}
+
+#define SMOKE_FILE      "@"     /* argument replaced by the generated input */
+
+/* tools for the smoke run: label, then argv */
+static const char *const smoke_tools[][8] = {
+    { "sort", "sort", "-k2", SMOKE_FILE, NULL },
+    { "awk",  "awk", "{ n[$2]++ } END { for (k in n) c++; print c }",
+      SMOKE_FILE, NULL },
+    { "gzip", "gzip", "-c", SMOKE_FILE, NULL },
+    { "ls",   "ls", "-lR", "/usr/include", NULL },
+    { "sh",   "sh", "-c", "cut -d' ' -f2 \"$0\" | sort | uniq -c | sort -n",
+      SMOKE_FILE, NULL },
+};
+
+#define NUM_TOOLS       (sizeof(smoke_tools) / sizeof(smoke_tools[0]))
+
+/*
+ * run_tool - run argv with lib in LD_PRELOAD (none if NULL) and hash
+ *            what it prints; its exit status, -1 if it was killed
+ */
+static int run_tool(char *const argv[], const char *lib, uint64_t *hash,
+                    double *secs, size_t *maxrss)
+{
+    char buf[1 << 16];
+    struct rusage ru;
+    double start = now();
+    int fd[2], status;
+    ssize_t n;
+    pid_t pid;
+
+    if (pipe(fd) < 0 || (pid = fork()) < 0) {
+        perror("mm_bench: run_tool");
+        exit(1);
+    }
+    if (pid == 0) {
+        dup2(fd[1], STDOUT_FILENO);
+        close(fd[0]);
+        close(fd[1]);
+        if (lib != NULL)
+            setenv("LD_PRELOAD", lib, 1);
+        else
+            unsetenv("LD_PRELOAD");
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    close(fd[1]);
+
+    /* FNV-1a over the whole output */
+    *hash = 14695981039346656037ULL;
+    while ((n = read(fd[0], buf, sizeof(buf))) > 0)
+        for (ssize_t i = 0; i < n; i++)
+            *hash = (*hash ^ (unsigned char)buf[i]) * 1099511628211ULL;
+    close(fd[0]);
+
+    if (wait4(pid, &status, 0, &ru) < 0) {
+        perror("mm_bench: wait4");
+        exit(1);
+    }
+    *secs = now() - start;
+    *maxrss = (size_t)ru.ru_maxrss * 1024;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/*
+ * smoke_run - run every tool with and without cfg->preload, 1 if one
+ *             of them failed or printed something else under it
+ */
+static int smoke_run(const struct config *cfg)
+{
+    char path[] = "/tmp/mm_benchXXXXXX";
+    char lib[PATH_MAX];
+    const char *label;
+    uint64_t state = 88172645463325252ULL;
+    long lines = cfg->ops / 10 > 0 ? cfg->ops / 10 : 1;
+    int failed = 0, fd;
+    FILE *fp;
+
+    if (realpath(cfg->preload, lib) == NULL) {
+        perror(cfg->preload);
+        exit(1);
+    }
+    label = strrchr(lib, '/') + 1;
+
+    if ((fd = mkstemp(path)) < 0 || (fp = fdopen(fd, "w")) == NULL) {
+        perror("mm_bench: smoke input");
+        exit(1);
+    }
+    for (long i = 0; i < lines; i++) {
+        uint64_t key = rnd(&state);
+
+        fprintf(fp, "%016llx w%llu %ld\n", (unsigned long long)key,
+                (unsigned long long)(rnd(&state) % 5000), i);
+    }
+    fclose(fp);
+
+    for (size_t t = 0; t < NUM_TOOLS; t++) {
+        char *argv[8];
+        uint64_t hash[2];
+        int status[2], i;
+
+        for (i = 0; smoke_tools[t][i + 1] != NULL; i++)
+            argv[i] = strcmp(smoke_tools[t][i + 1], SMOKE_FILE) ?
+                      (char *)smoke_tools[t][i + 1] : path;
+        argv[i] = NULL;
+
+        for (int run = 0; run < 2; run++) {
+            struct config c = *cfg;
+            struct result res = { smoke_tools[t][0], 1, lines, 0, 0 };
+
+            status[run] = run_tool(argv, run ? lib : NULL, &hash[run],
+                                   &res.secs, &res.heap);
+            c.name = run ? label : "libc";
+            print_result(&c, &res);
+        }
+
+        if (status[0] != 0)
+            fprintf(stderr, "mm_bench: %s fails without %s, skipped\n",
+                    smoke_tools[t][0], label);
+        else if (status[1] != 0 || hash[0] != hash[1]) {
+            fprintf(stderr, "mm_bench: %s %s under %s\n", smoke_tools[t][0],
+                    status[1] != 0 ? "fails" : "prints something else", label);
+            failed = 1;
+        }
+    }
+    unlink(path);
+    return failed;
+}
+
+int main(int argc, char **argv)
+{
+    struct config cfg = { ALLOC_NAME, 1000000, 2, 4096, 64, 4096, 4096 * 64, 0, 0, NULL };
+    int selected[NUM_WORKLOADS] = { 0 };
+    int any = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "a:chjl:m:n:p:s:t:w:")) != EOF) {
+        switch (c) {
+        case 'a':
+            cfg.name = optarg;
+            break;
+#ifdef BENCH_COPY
+        case 'c':
+            cfg.copy = 1;
+            break;
+#endif
+        case 'j':
+            cfg.json = 1;
+            break;
+        case 'l':
+            cfg.live = atoi(optarg);
+            break;
+        case 'm':
+            cfg.max_size = strtoul(optarg, NULL, 0);
+            cfg.max_realloc = cfg.max_size * 64;
+            break;
+        case 'n':
+            cfg.ops = atol(optarg);
+            break;
+        case 'p':
+            cfg.preload = optarg;
+            break;
+        case 's':
+            cfg.size = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            cfg.threads = atoi(optarg);
+            break;
+        case 'w': {
+            int i;
+
+            for (i = 0; i < NUM_WORKLOADS; i++)
+                if (!strcmp(optarg, workloads[i].name))
+                    break;
+            if (i == NUM_WORKLOADS) {
+                usage(argv[0]);
+                exit(1);
+            }
+            selected[i] = any = 1;
+            break;
+        }
+        case 'h':
+        default:
+            usage(argv[0]);
+            exit(c != 'h');
+        }
+    }
+
+    if (cfg.ops <= 0 || cfg.live <= 0 || cfg.live > MAX_LIVE || cfg.size == 0 ||
+        cfg.max_size < 16 || cfg.threads < 1 || cfg.threads > MAXTHREADS) {
+        usage(argv[0]);
+        exit(1);
+    }
+
+#ifndef BENCH_LIBC
+    mem_init();
+#endif
+
+    if (!cfg.json)
+        printf("allocator,workload,threads,ops,secs,mops,ns_per_op,heap_bytes\n");
+
+#ifdef BENCH_COPY
+    if (cfg.copy) {
+        copy_sweep(&cfg);
+        return 0;
+    }
+#endif
+    if (cfg.preload != NULL)
+        return smoke_run(&cfg);
+
+    for (int i = 0; i < NUM_WORKLOADS; i++) {
+        struct result res = { workloads[i].name, 1, 0, 0, 0 };
+
+        if (any && !selected[i])
+            continue;
+        reset_allocator();
+        workloads[i].fn(&cfg, &res);
+        res.heap = heap_size();
+        print_result(&cfg, &res);
+    }
+    return 0;
+}
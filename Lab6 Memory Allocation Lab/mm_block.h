@@ -0,0 +1,128 @@
+/*
+ * mm_block.h - block format shared by the allocator variants
+ *
+ * Every block has a header and a footer word of MM_WSIZE bytes:
+ *
+ *      W*8-1                    3  2  1  0
+ *      -----------------------------------
+ *     | s  s  s  s  ... s  s  s  0  0  a/f
+ *      -----------------------------------
+ *
+ * where s are the meaningful size bits and a/f is set if the block is
+ * allocated. Block sizes are always a multiple of MM_ALIGNMENT, so the
+ * low three bits of a word never carry size.
+ *
+ * Free blocks keep their list links in the first two payload words as
+ * offsets from the heap base instead of raw pointers. A zero offset is
+ * NULL (the heap base is the alignment padding, never a payload), and
+ * the links stay valid if the heap is mapped somewhere else.
+ *
+ *  free:      [ hdr | next | prev |     ...     | ftr ]
+ *  allocated: [ hdr |        payload           | ftr ]
+ *
+ * Configure before including (or with -D on the command line):
+ *
+ *  MM_WSIZE      4 or 8     header/footer/link word width (default 4)
+ *  MM_ALIGNMENT  power of 2 payload alignment, >= 2*MM_WSIZE (default 8)
+ *
+ * Words are read and written through mm_word_t only, so a 4-byte
+ * format never touches 8 bytes and the other way around.
+ */
+#ifndef __MM_BLOCK_H__
+#define __MM_BLOCK_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef MM_WSIZE
+#define MM_WSIZE        4
+#endif
+
+#ifndef MM_ALIGNMENT
+#define MM_ALIGNMENT    8
+#endif
+
+#if MM_WSIZE == 4
+typedef uint32_t mm_word_t;
+#elif MM_WSIZE == 8
+typedef uint64_t mm_word_t;
+#else
+#error "MM_WSIZE must be 4 or 8"
+#endif
+
+#if (MM_ALIGNMENT & (MM_ALIGNMENT - 1)) || MM_ALIGNMENT < 2 * MM_WSIZE
+#error "MM_ALIGNMENT must be a power of two and at least 2 * MM_WSIZE"
+#endif
+
+/* Basic constants and macros */
+#define WSIZE       MM_WSIZE            /* word and header/footer size (bytes) */
+#define DSIZE       (2 * MM_WSIZE)      /* doubleword size (bytes) */
+#define ALIGNMENT   MM_ALIGNMENT        /* payload alignment (bytes) */
+
+/* rounds up to the nearest multiple of ALIGNMENT */
+#define ALIGN(p)    (((size_t)(p) + (ALIGNMENT-1)) & ~(size_t)(ALIGNMENT-1))
+
+/* Low bits of a header/footer word that are not part of the size */
+#define FLAG_MASK   ((mm_word_t)0x7)
+#define ALLOC_BIT   ((mm_word_t)0x1)
+
+/* Read and write a word at address p */
+static inline mm_word_t mm_get(const void *p)
+{
+    return *(const mm_word_t *)p;
+}
+
+static inline void mm_put(void *p, mm_word_t val)
+{
+    *(mm_word_t *)p = val;
+}
+
+/* Pack a size and allocated bit into a word */
+static inline mm_word_t mm_pack(size_t size, mm_word_t alloc)
+{
+    return (mm_word_t)size | alloc;
+}
+
+#define PACK(size, alloc)  mm_pack((size), (alloc))
+#define GET(p)             mm_get(p)
+#define PUT(p, val)        mm_put((p), (val))
+
+/* Read the size and allocated fields from address p */
+#define GET_SIZE(p)  ((size_t)(GET(p) & ~FLAG_MASK))
+#define GET_ALLOC(p) (GET(p) & ALLOC_BIT)
+
+/* Given block ptr bp, compute address of its header and footer */
+#define HDRP(bp)       ((char *)(bp) - WSIZE)
+#define FTRP(bp)       ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
+
+/* Given block ptr bp, compute address of next and previous blocks */
+#define NEXT_BLKP(bp)  ((char *)(bp) + GET_SIZE((char *)(bp) - WSIZE))
+#define PREV_BLKP(bp)  ((char *)(bp) - GET_SIZE((char *)(bp) - DSIZE))
+
+/* Given free block ptr bp, compute address of its next/prev link words */
+#define NEXT_LINKP(bp) ((char *)(bp))
+#define PREV_LINKP(bp) ((char *)(bp) + WSIZE)
+
+/* Smallest block that can hold header, two links and footer */
+#define MIN_BLKSIZE    ALIGN(4 * WSIZE)
+
+/*
+ * mm_link_get - read the link word at p and turn it back into a block
+ *               pointer relative to the heap base
+ */
+static inline void *mm_link_get(const void *base, const void *p)
+{
+    mm_word_t offset = mm_get(p);
+
+    return offset ? (char *)base + offset : NULL;
+}
+
+/*
+ * mm_link_put - store block pointer bp at p as an offset from base
+ */
+static inline void mm_link_put(const void *base, void *p, const void *bp)
+{
+    mm_put(p, bp ? (mm_word_t)((const char *)bp - (const char *)base) : 0);
+}
+
+#endif /* __MM_BLOCK_H__ */
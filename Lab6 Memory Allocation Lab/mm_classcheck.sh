@@ -0,0 +1,65 @@
+#!/bin/sh
+#
+# mm_classcheck.sh - check a generated size class table on real traces
+#
+#  ./mm_classcheck.sh [-n <classes>] <trace>...
+#
+# Generates mm_classes.h from the traces with mm_classgen, twice, the
+# second time with the traces in reverse order, and compares the two
+# headers: the table has to depend on the counts only. Then builds
+# mm_replay against mm_core.c with the default doubling classes and
+# with -DMM_CLASSES and replays every trace through both with the heap
+# checked after each op. Run it where mdriver builds, memlib.c, mm.h
+# and memlib.h have to be here. Set CC or CFLAGS to override the
+# defaults; MM_WSIZE/MM_ALIGNMENT given in CFLAGS reach the generator
+# too, so it sizes blocks like the allocator does.
+#
+# Leaves mm_classes.h behind and exits non-zero on the first failure.
+
+CC=${CC:-gcc}
+CFLAGS=${CFLAGS:--O2}
+CLASSES=10
+
+if [ "$1" = "-n" ]; then
+    CLASSES=$2
+    shift 2
+fi
+if [ $# -eq 0 ]; then
+    echo "Usage: $0 [-n <classes>] <trace>..." >&2
+    exit 1
+fi
+
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+fail() {
+    echo "mm_classcheck: $*" >&2
+    exit 1
+}
+
+# the table, from the traces forward and backward
+fwd=
+rev=
+for t in "$@"; do
+    fwd="$fwd -t $t"
+    rev="-t $t $rev"
+done
+$CC $CFLAGS -o "$tmp/mm_classgen" mm_classgen.c || fail "mm_classgen does not build"
+"$tmp/mm_classgen" -n "$CLASSES" -o mm_classes.h $fwd || fail "mm_classgen failed"
+"$tmp/mm_classgen" -n "$CLASSES" -o "$tmp/mm_classes.h" $rev || fail "mm_classgen failed"
+cmp mm_classes.h "$tmp/mm_classes.h" || fail "the table depends on the trace order"
+"$tmp/mm_classgen" -n "$CLASSES" -c $fwd > /dev/null || fail "mm_classgen -c found a bad table"
+
+# both tables through the same traces, the heap checked as they go
+for table in default generated; do
+    defs="-DDRIVER"
+    [ $table = generated ] && defs="$defs -DMM_CLASSES"
+    $CC $CFLAGS $defs -o "$tmp/mm_replay" \
+        mm_replay.c mm_core.c mm_copy.c memlib.c || fail "$table table: build failed"
+    "$tmp/mm_replay" "$@" > "$tmp/out" || fail "$table table: replay failed"
+    if [ -s "$tmp/out" ]; then
+        head -20 "$tmp/out" >&2
+        fail "$table table: mm_checkheap found errors"
+    fi
+    echo "$table table: $# traces ok"
+done
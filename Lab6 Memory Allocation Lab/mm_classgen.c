@@ -0,0 +1,426 @@
+/*
+ * mm_classgen.c - generate a size class table for mm_core.c
+ *
+ * Reads block size counts from mdriver traces (-t) or from histogram
+ * files of "size count" lines ('#' starts a comment), and writes a
+ * header (mm_classes.h) that mm_core.c compiles in with -DMM_CLASSES:
+ *
+ *  gcc -O2 -o mm_classgen mm_classgen.c
+ *  ./mm_classgen -n 12 -o mm_classes.h -t amptjp.rep -t cccp.rep ...
+ *  gcc -O2 -DDRIVER -DMM_CLASSES -c mm_core.c
+ *
+ * Build the generator with the same MM_WSIZE/MM_ALIGNMENT as mm_core.c,
+ * request sizes are turned into block sizes the way the allocator does.
+ *
+ * With a size-ordered seglist, a malloc walks its class list and a free
+ * walks it again to insert, so the cost of a class grows with how many
+ * requests land in it. The block sizes up to the table size (-m) are
+ * split into classes that minimize the sum over classes of (requests
+ * in class)^2, an exact dynamic program over the distinct sizes. Above
+ * the table, free lists fill up with split remainders the histogram
+ * knows nothing about, so the last -l classes keep doubling like the
+ * default ones. The result depends only on the counts, not on the
+ * order of the input, and ties go to the smaller boundary, so the same
+ * traces always give the same table.
+ *
+ * Sizes up to CLASS_TABLE_MAX get their class from a direct table
+ * lookup; larger ones scan the class limits from the table's last class.
+ *
+ * -c checks the generated table against its limits for every size and
+ * replays the input through both the default doubling classes and the
+ * new ones, printing per-class counts and the cost of each. That only
+ * re-buckets the counts; mm_classcheck.sh also replays the traces
+ * through mm_core.c built with each table (mm_replay.c), with the heap
+ * checked after every op, and makes sure the header comes out the same
+ * whatever order the traces are given in.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mm_block.h"
+
+#define MAX_CLASSES     32
+#define DEF_CLASSES     10
+#define DEF_TABLE_MAX   1024    /* largest size looked up directly (bytes) */
+#define DEF_LARGE       3       /* doubling classes above it */
+#define MAXLINE         1024
+
+#define MAX(x, y) ((x) > (y)? (x) : (y))
+#define MIN(x, y) ((x) < (y)? (x) : (y))
+
+/* one distinct block size and how often it was requested */
+struct bin {
+    size_t size;
+    double count;
+};
+
+static struct bin *bins;
+static int num_bins, max_bins;
+
+/*
+ * adjust_size - block size for a request, as mm_core.c computes it
+ */
+static size_t adjust_size(size_t size)
+{
+    return MAX(ALIGN(size + DSIZE), MIN_BLKSIZE);
+}
+
+static void add_size(size_t bytes, double count)
+{
+    if (num_bins == max_bins) {
+        max_bins = max_bins ? 2 * max_bins : 1024;
+        if ((bins = realloc(bins, max_bins * sizeof(*bins))) == NULL) {
+            fprintf(stderr, "mm_classgen: out of memory\n");
+            exit(1);
+        }
+    }
+    bins[num_bins].size = adjust_size(bytes);
+    bins[num_bins].count = count;
+    num_bins++;
+}
+
+/*
+ * read_trace - count the a and r requests of an mdriver trace
+ */
+static void read_trace(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    char line[MAXLINE];
+    int skip = 4;       /* heap size, ids, ops, weight */
+    unsigned long id, bytes;
+    char op;
+
+    if (fp == NULL) {
+        perror(path);
+        exit(1);
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (skip > 0) {
+            skip--;
+            continue;
+        }
+        if (sscanf(line, " %c %lu %lu", &op, &id, &bytes) == 3 &&
+            (op == 'a' || op == 'r') && bytes > 0)
+            add_size(bytes, 1);
+    }
+    fclose(fp);
+}
+
+/*
+ * read_histogram - read "size count" lines
+ */
+static void read_histogram(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    char line[MAXLINE];
+    unsigned long bytes;
+    double count;
+
+    if (fp == NULL) {
+        perror(path);
+        exit(1);
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char *hash = strchr(line, '#');
+
+        if (hash != NULL)
+            *hash = '\0';
+        if (sscanf(line, "%lu %lf", &bytes, &count) == 2 && bytes > 0 && count > 0)
+            add_size(bytes, count);
+    }
+    fclose(fp);
+}
+
+static int cmp_bin(const void *a, const void *b)
+{
+    const struct bin *x = a, *y = b;
+
+    return (x->size > y->size) - (x->size < y->size);
+}
+
+/*
+ * merge_bins - sort by block size and add up the counts of equal sizes
+ */
+static void merge_bins(void)
+{
+    int n = 0;
+
+    qsort(bins, num_bins, sizeof(*bins), cmp_bin);
+    for (int i = 0; i < num_bins; i++) {
+        if (n > 0 && bins[n - 1].size == bins[i].size)
+            bins[n - 1].count += bins[i].count;
+        else
+            bins[n++] = bins[i];
+    }
+    num_bins = n;
+}
+
+/*
+ * partition - k classes, limit[c] being the last size of class c: the
+ *             bins up to table_max split into k - large classes that
+ *             minimize the sum of squared class counts, then large
+ *             classes doubling from table_max, the last one open ended
+ */
+static int partition(int k, size_t table_max, int large, size_t *limit)
+{
+    int m = 0;
+    double *prefix, *cost;
+    int *cut;
+
+    while (m < num_bins && bins[m].size <= table_max)
+        m++;
+    prefix = calloc(m + 1, sizeof(double));
+    cost = malloc((size_t)(k + 1) * (m + 1) * sizeof(double));
+    cut = malloc((size_t)(k + 1) * (m + 1) * sizeof(int));
+    if (prefix == NULL || cost == NULL || cut == NULL) {
+        fprintf(stderr, "mm_classgen: out of memory\n");
+        exit(1);
+    }
+    k = MAX(MIN(k - large, m), 1);
+    for (int i = 0; i < m; i++)
+        prefix[i + 1] = prefix[i] + bins[i].count;
+
+#define COST(c, j)  cost[(size_t)(c) * (m + 1) + (j)]
+#define CUT(c, j)   cut[(size_t)(c) * (m + 1) + (j)]
+    /* COST(c, j): best cost of the first j bins in c classes */
+    for (int j = 0; j <= m; j++)
+        COST(1, j) = prefix[j] * prefix[j];
+    for (int c = 2; c <= k; c++) {
+        for (int j = c; j <= m; j++) {
+            COST(c, j) = -1;
+            /* last class is bins i .. j-1; strict < keeps the first,
+             * smallest cut on ties */
+            for (int i = c - 1; i < j; i++) {
+                double s = prefix[j] - prefix[i];
+                double total = COST(c - 1, i) + s * s;
+
+                if (COST(c, j) < 0 || total < COST(c, j)) {
+                    COST(c, j) = total;
+                    CUT(c, j) = i;
+                }
+            }
+        }
+    }
+
+    for (int c = k, j = m; c >= 1 && j > 0; c--) {
+        limit[c - 1] = bins[j - 1].size;
+        j = c > 1 ? CUT(c, j) : 0;
+    }
+#undef COST
+#undef CUT
+
+    /* the sizes in between go with the last small class */
+    limit[k - 1] = table_max;
+    for (int i = 1; i < large; i++)
+        limit[k++] = table_max << i;
+    limit[k - 1 + (large > 0)] = SIZE_MAX;
+    k += large > 0;
+
+    free(prefix);
+    free(cost);
+    free(cut);
+    return k;
+}
+
+/*
+ * class_of - class of block size in a table given by its limits
+ */
+static int class_of(const size_t *limit, int k, size_t size)
+{
+    int c = 0;
+
+    while (c < k - 1 && size > limit[c])
+        c++;
+    return c;
+}
+
+/*
+ * write_header - the table as C constants; nothing in it depends on
+ *                file names or order, so equal inputs give equal bytes
+ */
+static void write_header(FILE *fp, const size_t *limit, int k, size_t table_max)
+{
+    double requests = 0;
+
+    for (int i = 0; i < num_bins; i++)
+        requests += bins[i].count;
+
+    fprintf(fp, "/*\n * mm_classes.h - size classes for mm_core.c -DMM_CLASSES\n *\n");
+    fprintf(fp, " * Generated by mm_classgen from %.0f requests of %d block sizes,\n",
+            requests, num_bins);
+    fprintf(fp, " * do not edit.\n */\n");
+    fprintf(fp, "#ifndef __MM_CLASSES_H__\n#define __MM_CLASSES_H__\n\n");
+    fprintf(fp, "#include <stddef.h>\n#include <stdint.h>\n\n");
+    fprintf(fp, "/* block format the table was generated for */\n");
+    fprintf(fp, "#define MM_CLASSES_WSIZE        %d\n", WSIZE);
+    fprintf(fp, "#define MM_CLASSES_ALIGNMENT    %d\n\n", ALIGNMENT);
+    fprintf(fp, "#define NUM_FREELIST            %d\n", k);
+    fprintf(fp, "#define CLASS_TABLE_MAX         %zu\n\n", table_max);
+
+    fprintf(fp, "/* largest block size in each class */\n");
+    fprintf(fp, "static const size_t class_limit[NUM_FREELIST] = {\n");
+    for (int c = 0; c < k; c++) {
+        if (limit[c] == SIZE_MAX)
+            fprintf(fp, "    SIZE_MAX,\n");
+        else
+            fprintf(fp, "    %zu,\n", limit[c]);
+    }
+    fprintf(fp, "};\n\n");
+
+    fprintf(fp, "/* class of block size s <= CLASS_TABLE_MAX is class_table[s / %d] */\n",
+            ALIGNMENT);
+    fprintf(fp, "static const unsigned char class_table[CLASS_TABLE_MAX / %d + 1] = {",
+            ALIGNMENT);
+    for (size_t s = 0; s <= table_max; s += ALIGNMENT) {
+        if (s % (16 * ALIGNMENT) == 0)
+            fprintf(fp, "\n   ");
+        fprintf(fp, " %d,", class_of(limit, k, s));
+    }
+    fprintf(fp, "\n};\n\n#endif /* __MM_CLASSES_H__ */\n");
+}
+
+static void print_limit(size_t limit)
+{
+    if (limit == SIZE_MAX)
+        printf(" %12s", "inf");
+    else
+        printf(" %12zu", limit);
+}
+
+/*
+ * check - replay the input through the default and the new classes
+ */
+static int check(const size_t *limit, int k, size_t table_max)
+{
+    size_t dlimit[MAX_CLASSES];
+    double dcount[MAX_CLASSES] = { 0 }, ncount[MAX_CLASSES] = { 0 };
+    double dcost = 0, ncost = 0;
+    int errors = 0;
+
+    /* mm_core.c default: classes double from 4 * DSIZE, DEF_CLASSES of them */
+    for (int c = 0; c < DEF_CLASSES; c++)
+        dlimit[c] = c == DEF_CLASSES - 1 ? SIZE_MAX : (size_t)4 * DSIZE << c;
+
+    /* limits ascend, the direct table agrees with them */
+    for (int c = 1; c < k; c++)
+        if (limit[c] <= limit[c - 1]) {
+            printf("Error: class %d limit %zu not above class %d\n", c, limit[c], c - 1);
+            errors++;
+        }
+    for (size_t s = 0; s <= table_max; s += ALIGNMENT) {
+        int c = class_of(limit, k, s);
+
+        if ((c > 0 && s <= limit[c - 1]) || s > limit[c]) {
+            printf("Error: size %zu in class %d outside its limits\n", s, c);
+            errors++;
+        }
+    }
+
+    for (int i = 0; i < num_bins; i++) {
+        dcount[class_of(dlimit, DEF_CLASSES, bins[i].size)] += bins[i].count;
+        ncount[class_of(limit, k, bins[i].size)] += bins[i].count;
+    }
+
+    printf("%-6s %12s %14s %12s %14s\n", "class", "default max", "requests",
+           "new max", "requests");
+    for (int c = 0; c < MAX(k, DEF_CLASSES); c++) {
+        printf("%-6d", c);
+        if (c < DEF_CLASSES) {
+            print_limit(dlimit[c]);
+            printf(" %14.0f", dcount[c]);
+            dcost += dcount[c] * dcount[c];
+        } else {
+            printf(" %12s %14s", "", "");
+        }
+        if (c < k) {
+            print_limit(limit[c]);
+            printf(" %14.0f", ncount[c]);
+            ncost += ncount[c] * ncount[c];
+        }
+        printf("\n");
+    }
+    printf("cost (sum of squared class counts): default %.4g, new %.4g (%.1f%%)\n",
+           dcost, ncost, dcost > 0 ? 100.0 * (ncost - dcost) / dcost : 0.0);
+    return errors;
+}
+
+static void usage(char *prog)
+{
+    fprintf(stderr, "Usage: %s [-ch] [-n <classes>] [-l <classes>] [-m <table max>] [-o <file>] "
+            "[-t <trace>]... [<histogram>]...\n", prog);
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-c            Check the table and compare it with the default classes.\n");
+    fprintf(stderr, "\t-h            Print this message.\n");
+    fprintf(stderr, "\t-l <classes>  Doubling classes above the table (default %d).\n", DEF_LARGE);
+    fprintf(stderr, "\t-m <max>      Largest size looked up directly (default %d).\n", DEF_TABLE_MAX);
+    fprintf(stderr, "\t-n <classes>  Number of classes, 1 to %d (default %d).\n", MAX_CLASSES, DEF_CLASSES);
+    fprintf(stderr, "\t-o <file>     Write the header here instead of stdout.\n");
+    fprintf(stderr, "\t-t <trace>    Read an mdriver trace; repeatable.\n");
+}
+
+int main(int argc, char **argv)
+{
+    size_t limit[MAX_CLASSES];
+    size_t table_max = DEF_TABLE_MAX;
+    int classes = DEF_CLASSES, large = DEF_LARGE, do_check = 0;
+    char *outfile = NULL;
+    FILE *fp = stdout;
+    int c, k;
+
+    while ((c = getopt(argc, argv, "chl:m:n:o:t:")) != EOF) {
+        switch (c) {
+        case 'c':
+            do_check = 1;
+            break;
+        case 'l':
+            large = atoi(optarg);
+            break;
+        case 'm':
+            table_max = ALIGN(strtoul(optarg, NULL, 0));
+            break;
+        case 'n':
+            classes = atoi(optarg);
+            break;
+        case 'o':
+            outfile = optarg;
+            break;
+        case 't':
+            read_trace(optarg);
+            break;
+        case 'h':
+        default:
+            usage(argv[0]);
+            exit(c != 'h');
+        }
+    }
+    for (int i = optind; i < argc; i++)
+        read_histogram(argv[i]);
+
+    if (classes < 1 || classes > MAX_CLASSES || table_max == 0 ||
+        large < 0 || large >= classes) {
+        usage(argv[0]);
+        exit(1);
+    }
+    if (num_bins == 0) {
+        fprintf(stderr, "mm_classgen: no sizes in the input\n");
+        exit(1);
+    }
+
+    merge_bins();
+    k = partition(classes, table_max, large, limit);
+
+    if (do_check)
+        return check(limit, k, table_max) ? 1 : 0;
+
+    if (outfile != NULL && (fp = fopen(outfile, "w")) == NULL) {
+        perror(outfile);
+        exit(1);
+    }
+    write_header(fp, limit, k, table_max);
+    if (fp != stdout)
+        fclose(fp);
+    return 0;
+}
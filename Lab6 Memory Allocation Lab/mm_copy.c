@@ -0,0 +1,154 @@
+/*
+ * mm_copy.c - copying large payloads
+ *
+ * A copy that does not fit in the last level cache gains nothing from
+ * going through it: every line it writes is first read for ownership
+ * and then pushes out a line somebody still needed. Non-temporal
+ * stores write combine straight to memory instead. Below the threshold
+ * mm_memcpy is plain memcpy, which is as fast as it gets there.
+ *
+ * The threshold is 3/4 of the last level cache (the rest is left for
+ * the source), MM_NT_THRESHOLD if the cache size is unknown, or the
+ * value of MM_NT_THRESHOLD in the environment. The store loop is
+ * picked once, at the first large copy, from the CPU's features.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MM_X86
+#endif
+
+#include "mm_copy.h"
+
+/* non-temporal threshold when the cache size is unknown (bytes) */
+#ifndef MM_NT_THRESHOLD
+#define MM_NT_THRESHOLD ((size_t)1 << 22)
+#endif
+
+#define MIN(x, y) ((x) < (y)? (x) : (y))
+
+typedef void (*copy_fn)(char *dst, const char *src, size_t n);
+
+static copy_fn copy_large;      /* NULL until picked */
+static size_t nt_threshold;
+
+#ifdef MM_X86
+
+/*
+ * copy_nt_avx2 - 128 bytes per round, 32-byte aligned streaming stores
+ */
+__attribute__((target("avx2")))
+static void copy_nt_avx2(char *dst, const char *src, size_t n)
+{
+    size_t head = MIN(-(uintptr_t)dst & 31, n);
+
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    n -= head;
+
+    for (; n >= 128; n -= 128, dst += 128, src += 128) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)src);
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i *)(src + 64));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(src + 96));
+
+        _mm256_stream_si256((__m256i *)dst, a);
+        _mm256_stream_si256((__m256i *)(dst + 32), b);
+        _mm256_stream_si256((__m256i *)(dst + 64), c);
+        _mm256_stream_si256((__m256i *)(dst + 96), d);
+    }
+    /* streaming stores are weakly ordered, fence before anyone looks */
+    _mm_sfence();
+    memcpy(dst, src, n);
+}
+
+/*
+ * copy_nt_sse2 - 64 bytes per round, 16-byte aligned streaming stores
+ */
+__attribute__((target("sse2")))
+static void copy_nt_sse2(char *dst, const char *src, size_t n)
+{
+    size_t head = MIN(-(uintptr_t)dst & 15, n);
+
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    n -= head;
+
+    for (; n >= 64; n -= 64, dst += 64, src += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i *)src);
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(src + 32));
+        __m128i d = _mm_loadu_si128((const __m128i *)(src + 48));
+
+        _mm_stream_si128((__m128i *)dst, a);
+        _mm_stream_si128((__m128i *)(dst + 16), b);
+        _mm_stream_si128((__m128i *)(dst + 32), c);
+        _mm_stream_si128((__m128i *)(dst + 48), d);
+    }
+    _mm_sfence();
+    memcpy(dst, src, n);
+}
+
+#endif /* def MM_X86 */
+
+static void copy_plain(char *dst, const char *src, size_t n)
+{
+    memcpy(dst, src, n);
+}
+
+/*
+ * copy_setup - pick the threshold and the store loop for this machine
+ */
+static void copy_setup(void)
+{
+    char *env = getenv("MM_NT_THRESHOLD");
+    size_t threshold = MM_NT_THRESHOLD;
+    copy_fn fn = copy_plain;
+
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    {
+        long llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+
+        if (llc > 0)
+            threshold = (size_t)llc / 4 * 3;
+    }
+#endif
+    if (env != NULL && atol(env) > 0)
+        threshold = atol(env);
+
+#ifdef MM_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        fn = copy_nt_avx2;
+    else if (__builtin_cpu_supports("sse2"))
+        fn = copy_nt_sse2;
+#endif
+
+    /* racing threads compute the same values */
+    __atomic_store_n(&nt_threshold, threshold, __ATOMIC_RELAXED);
+    __atomic_store_n(&copy_large, fn, __ATOMIC_RELEASE);
+}
+
+/*
+ * mm_memcpy - memcpy, streaming past the cache above the threshold
+ */
+void *mm_memcpy(void *dst, const void *src, size_t n)
+{
+    copy_fn fn = __atomic_load_n(&copy_large, __ATOMIC_ACQUIRE);
+
+    if (fn == NULL) {
+        copy_setup();
+        fn = __atomic_load_n(&copy_large, __ATOMIC_ACQUIRE);
+    }
+    if (n < nt_threshold)
+        return memcpy(dst, src, n);
+
+    fn(dst, src, n);
+    return dst;
+}
@@ -0,0 +1,16 @@
+/*
+ * mm_copy.h - copying large payloads
+ */
+#ifndef __MM_COPY_H__
+#define __MM_COPY_H__
+
+#include <stddef.h>
+
+/*
+ * memcpy for block payloads. Copies larger than the last level cache
+ * use non-temporal stores, AVX2 or SSE2 as the CPU allows, so moving
+ * a big block does not evict the rest of the working set.
+ */
+void *mm_memcpy(void *dst, const void *src, size_t n);
+
+#endif /* __MM_COPY_H__ */
@@ -0,0 +1,1840 @@
+/*
+ * mm_core.c
+ *
+ * Segregated free list allocator built on the shared block format in
+ * mm_block.h. This is the 족보.c design (seglist roots kept as prologue
+ * blocks at the start of the heap, boundary tag coalescing) with the
+ * placement and list policies made selectable at compile time, so the
+ * same source builds every configuration the driver has to measure.
+ *
+ * begin                                                          end
+ * heap                                                           heap
+ *  -----------------------------------------------------------------
+ * |  pad   | | | | | | | | | | | | zero or more usr blks | hdr(0:a) |
+ *  -----------------------------------------------------------------
+ *          |       seglist       |                       | epilogue |
+ *          |        roots        |                       | block    |
+ *
+ * Each root is an allocated MIN_BLKSIZE block whose next link is the
+ * head of the list for its class. Links are offsets from the heap base.
+ *
+ * Link with mm_copy.o, which does the copying for realloc.
+ *
+ * Build options (all optional, e.g. -DMM_WSIZE=8 -DMM_ALIGNMENT=16):
+ *
+ *  MM_WSIZE       4 | 8                 word width, see mm_block.h
+ *  MM_ALIGNMENT   8 | 16 | ...          payload alignment
+ *  NUM_FREELIST   1 .. 32               size classes, 1 = one explicit list
+ *  MM_FIT         MM_FIT_FIRST | MM_FIT_BEST
+ *  MM_ORDER       MM_ORDER_SIZE | MM_ORDER_LIFO | MM_ORDER_ADDR
+ *  CHUNKSIZE      heap extension unit (bytes)
+ *  MM_THREADS     thread-safe build with one arena per NUMA node
+ *  MM_HUGEPAGE    huge page friendly heaps (link mm_region.o)
+ *  MM_GUARD       guard pages behind large blocks when MM_GUARD=bytes is
+ *                 set in the environment (link mm_guard.o, see mm_guard.h)
+ *  MM_HINTS       separate pool for long-lived blocks, see mm_malloc_hint
+ *  MM_PREFETCH    0 | 1                 prefetch the next free block in list
+ *                                       walks (default 1)
+ *  MM_CLASSES     size classes and NUM_FREELIST from mm_classes.h, made
+ *                 from trace histograms by mm_classgen
+ *
+ * NUMA arenas (-DMM_THREADS, link mm_region.o and -lpthread):
+ * each node gets an arena, a heap of its own on a region reserved for
+ * it (mm_region.c) and bound to the node. malloc serves the thread from
+ * the arena of the node its CPU belongs to, found with getcpu. A free
+ * from another node, or one that finds the owner's lock busy, never
+ * waits for that lock: the block is pushed onto the owner's remote
+ * list, a lock-free multi-producer single-consumer stack, and the owner
+ * takes the whole list in one exchange and frees it on its next malloc
+ * (or uncontended free). MM_NUMA_NODES=n in the environment simulates n
+ * nodes by mapping CPU c to node c % n; simulated arenas rely on first
+ * touch instead of mbind, so this works on a single-node box as well.
+ * pthread_atfork handlers take every allocator lock around fork, so a
+ * child forked while another thread was inside malloc does not inherit
+ * a lock nobody will ever release; the child starts with fresh locks.
+ *
+ * Huge page heaps (-DMM_HUGEPAGE): instead of growing through mem_sbrk
+ * in CHUNKSIZE steps, each heap reserves MM_HEAP_RESERVE bytes of
+ * address space on a 2 MiB boundary and opens it one 2 MiB chunk at a
+ * time with MADV_HUGEPAGE, so the kernel can back every chunk with a
+ * single huge page. The seglist roots and the first small blocks then
+ * share the first huge page, and the hot metadata costs one TLB entry.
+ *
+ * Lifetime pools (-DMM_HINTS): blocks allocated with MM_HINT_LONG get
+ * a second set of free lists and a bit in their header and footer.
+ * A long-lived block is only ever carved from long-lived free space and
+ * free blocks only coalesce within their pool, so heap chunks end up
+ * holding one kind of block. A cache entry that outlives its request
+ * then no longer pins a hole between short-lived blocks that have all
+ * been freed. Plain malloc and the other hints use the default pool.
+ *
+ * Heap images (mm_snapshot / mm_restore, single heap builds only):
+ * the heap is written out as it is, behind a header that records the
+ * address it lived at. Free list links are offsets from the heap base
+ * and need no fixup, but the caller's own pointers inside its blocks
+ * are absolute, so the image has to come back at the same address.
+ * With MM_HUGEPAGE the heap's region is reserved there again and the
+ * file is mapped into it copy-on-write, so a warm start costs a few
+ * page faults instead of rebuilding every structure; on the plain
+ * memlib heap the image is read back only if memlib got the same base.
+ *
+ * Shared library (mm_preload.c): the thread-safe build sets itself up
+ * on first use, so it can stand in for the C library's malloc under
+ * LD_PRELOAD; mm_memalign and mm_usable_size supply the rest of the
+ * malloc family.
+ *
+ * Sized free (mm_free_sized): the caller passes the size it asked for,
+ * or the mm_usable_size it grew into. The block size still comes from
+ * the header, since place() leaves up to MIN_BLKSIZE - ALIGNMENT of
+ * slack unsplit and coalescing reads the neighbours' tags anyway; what
+ * the size saves is the guard tag check for blocks too small to have
+ * been guarded. -DDEBUG checks the size against the block.
+ *
+ * Handles (mm_halloc / mm_hderef, single heap builds only): a handle
+ * names a block through a slot of the handle table, and the block's
+ * first word names the slot back, ahead of an ALIGNMENT sized gap.
+ * Nothing but the table points at such a block, so mm_hcompact can
+ * slide it down into the free block in front of it and coalesce the
+ * free space it leaves behind with whatever follows. Ordinary blocks
+ * stay where they are and the walk resumes behind the next free block.
+ * A pointer from mm_hderef is good until the next mm_hcompact.
+ */
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "mm_block.h"
+#include "mm_copy.h"
+#include "mm_ext.h"
+
+#if defined(MM_THREADS) || defined(MM_HUGEPAGE)
+#define MM_REGIONS      /* heaps grow in mm_region ranges, not mem_sbrk */
+#include "mm_region.h"
+#endif
+
+#ifdef MM_THREADS
+#include <pthread.h>
+#endif
+
+#ifdef MM_GUARD
+#include "mm_guard.h"
+#endif
+
+
+/* If you want debugging output, use the following macro.  When you hand
+ * in, remove the #define DEBUG line. */
+
+#ifdef DEBUG
+# define dbg_printf(...) printf(__VA_ARGS__)
+# define dbg_printblock(h, a) printblock(h, a)
+#else
+# define dbg_printf(...)
+# define dbg_printblock(h, a)
+#endif
+
+
+/* do not change the following! */
+#ifdef DRIVER
+/* create aliases for driver tests */
+#define malloc mm_malloc
+#define free mm_free
+#define realloc mm_realloc
+#define calloc mm_calloc
+#endif /* def DRIVER */
+
+
+/* Placement policies */
+#define MM_FIT_FIRST    1   /* first block in the class list that fits */
+#define MM_FIT_BEST     2   /* smallest block in the first class that has one */
+
+/* Free list ordering policies */
+#define MM_ORDER_SIZE   1   /* ascending size: first fit is best fit per class */
+#define MM_ORDER_LIFO   2   /* push at the head, O(1) insert */
+#define MM_ORDER_ADDR   3   /* ascending address, less fragmentation */
+
+#ifndef MM_FIT
+#define MM_FIT          MM_FIT_FIRST
+#endif
+
+#ifndef MM_ORDER
+#define MM_ORDER        MM_ORDER_SIZE
+#endif
+
+#ifndef MM_PREFETCH
+#define MM_PREFETCH     1
+#endif
+
+/* class no: 0 - NUM_FREELIST-1 */
+#ifdef MM_CLASSES
+#include "mm_classes.h"
+#if MM_CLASSES_WSIZE != WSIZE || MM_CLASSES_ALIGNMENT != ALIGNMENT
+#error "mm_classes.h was generated for another block format"
+#endif
+#endif
+
+#ifndef NUM_FREELIST
+#define NUM_FREELIST    10
+#endif
+
+#ifndef CHUNKSIZE
+#define CHUNKSIZE       (1<<12)     /* extend heap by this amount (bytes) */
+#endif
+
+#if NUM_FREELIST < 1 || NUM_FREELIST > 32
+#error "NUM_FREELIST must be between 1 and 32"
+#endif
+
+/* Lifetime pools: each has NUM_FREELIST lists of its own */
+#ifdef MM_HINTS
+#define NUM_POOLS       2
+#define POOL_BIT        ((mm_word_t)0x4)    /* block is in the long-lived pool */
+#else
+#define NUM_POOLS       1
+#define POOL_BIT        ((mm_word_t)0)
+#endif
+
+#define NUM_LISTS       (NUM_POOLS * NUM_FREELIST)
+
+/* Read the pool bit from address p, ready to be or'ed into PACK */
+#define GET_POOL(p)     (GET(p) & POOL_BIT)
+
+#define MAX(x, y) ((x) > (y)? (x) : (y))
+#define MIN(x, y) ((x) < (y)? (x) : (y))
+
+/* largest payload asked for; adjust_size must not wrap, nor a size word */
+#define MAX_PAYLOAD     ((size_t)((mm_word_t)-1 >> 1))
+
+/* padding in front of the first root so that its payload is aligned */
+#define HEAP_PAD        (ALIGNMENT - WSIZE)
+
+/* Size of the root area, up to and including the epilogue header */
+#define ROOTS_SIZE      (HEAP_PAD + NUM_LISTS * MIN_BLKSIZE + WSIZE)
+
+/*
+ * A heap: the bytes between base and the epilogue. Everything the
+ * allocator knows about a heap lives here, so several can coexist.
+ */
+struct mm_heap {
+    char *base;     /* first byte of the heap; free links are offsets from here */
+    char *roots;    /* block pointer of the class 0 root */
+#ifdef MM_REGIONS
+    struct mm_region *region;   /* range the heap grows in */
+#endif
+};
+
+#ifdef MM_REGIONS
+
+/* address space reserved per heap, link offsets must fit in a word */
+#ifndef MM_HEAP_RESERVE
+#define MM_HEAP_RESERVE ((size_t)1 << 30)
+#endif
+
+#ifdef MM_HUGEPAGE
+#define REGION_FLAGS    MM_REGION_HUGE
+#else
+#define REGION_FLAGS    0
+#endif
+
+#endif /* def MM_REGIONS */
+
+#ifdef MM_THREADS
+
+/*
+ * An arena: the heap of one NUMA node and the lock that guards it.
+ * remote collects blocks freed without the lock; they are chained
+ * through their first payload word. It gets a cache line of its own
+ * so that pushing to it does not steal the line holding the lock.
+ */
+struct mm_arena {
+    struct mm_heap heap;
+    struct mm_region region;
+    pthread_mutex_t lock;           /* guards heap */
+    int live;                       /* heap and lock are initialized */
+    void *remote __attribute__((aligned(64)));  /* blocks to free here */
+} __attribute__((aligned(64)));
+
+static struct mm_arena arenas[MM_MAX_NODES];
+static int num_nodes;               /* 0 until set up */
+static int simulated;               /* num_nodes comes from MM_NUMA_NODES */
+static pthread_mutex_t arena_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t atfork_once = PTHREAD_ONCE_INIT;
+
+static int arena_setup(int reset);
+static struct mm_arena *arena_get(void);
+static struct mm_arena *arena_of(void *bp);
+static void arena_remote_free(struct mm_arena *a, void *bp);
+static void arena_drain(struct mm_arena *a);
+static void arena_atfork(void);
+
+#else
+
+static struct mm_heap main_heap;
+#ifdef MM_REGIONS
+static struct mm_region main_region;
+#endif
+
+/* handle table: block of each handle, or a link in the free slot list */
+static void **handles;              /* slot 0 stays NULL, no handle is 0 */
+static size_t num_handles;          /* slots in handles */
+static size_t free_handle;          /* first free slot, 0 if none */
+
+static void handle_reset(void);
+static void handle_check(int verbose);
+
+#endif /* def MM_THREADS */
+
+/* function prototypes for internal helper routines */
+static int heap_init(struct mm_heap *h);
+static void *alloc_block(size_t size, mm_word_t pool);
+static void free_block(void *bp);
+static void *heap_malloc(struct mm_heap *h, size_t size, mm_word_t pool);
+static void *heap_memalign(struct mm_heap *h, size_t alignment, size_t size);
+static void heap_free(struct mm_heap *h, void *bp);
+static void *heap_resize(struct mm_heap *h, void *bp, size_t size);
+static void *resize_in_place(void *bp, size_t size);
+static void heap_check(struct mm_heap *h, int verbose);
+static void *extend_heap(struct mm_heap *h, size_t words, mm_word_t pool);
+static void place(struct mm_heap *h, void *bp, size_t asize);
+static void *find_fit(struct mm_heap *h, size_t asize, mm_word_t pool);
+static void *coalesce(struct mm_heap *h, void *bp);
+static void delete_freenode(struct mm_heap *h, void *bp);
+static void insert_freenode(struct mm_heap *h, void *bp);
+static void printblock(struct mm_heap *h, void *bp);
+static void printfreelist(struct mm_heap *h);
+static void checkblock(struct mm_heap *h, void *bp);
+static void checkfreelist(struct mm_heap *h, int freeblockcount);
+static int getclass(size_t size);
+static int aligned(const void *p);
+static int in_heap(struct mm_heap *h, const void *p);
+
+/*
+ * getroot - Get root node for corresponding list (pool and class)
+ */
+static inline void *getroot(struct mm_heap *h, int list)
+{
+    return h->roots + list * MIN_BLKSIZE;
+}
+
+/*
+ * getlist - list number of the class for size in the pool of bit pool
+ */
+static inline int getlist(size_t size, mm_word_t pool)
+{
+    return (pool ? NUM_FREELIST : 0) + getclass(size);
+}
+
+/*
+ * next_free_blck / prev_free_blck - follow the links of free block bp
+ */
+static inline void *next_free_blck(struct mm_heap *h, void *bp)
+{
+    return mm_link_get(h->base, NEXT_LINKP(bp));
+}
+
+static inline void *prev_free_blck(struct mm_heap *h, void *bp)
+{
+    return mm_link_get(h->base, PREV_LINKP(bp));
+}
+
+/*
+ * prefetch_blck - start loading the header and links of free block bp,
+ *                 if any, while the caller is still busy with another
+ *                 block. Header and next link are adjacent words, so
+ *                 one line brings both unless bp starts a cache line.
+ */
+static inline void prefetch_blck(void *bp, int for_write)
+{
+#if MM_PREFETCH
+    if (bp != NULL) {
+        if (for_write)
+            __builtin_prefetch(HDRP(bp), 1);
+        else
+            __builtin_prefetch(HDRP(bp), 0);
+    }
+#else
+    (void)bp;
+    (void)for_write;
+#endif
+}
+
+/*
+ * adjust_size - block size for a request of size payload bytes
+ */
+static inline size_t adjust_size(size_t size)
+{
+    return MAX(ALIGN(size + DSIZE), MIN_BLKSIZE);
+}
+
+/*
+ * payload_size - payload bytes of allocated block bp
+ */
+static inline size_t payload_size(void *bp)
+{
+#ifdef MM_GUARD
+    if (mm_guard_threshold && IS_GUARDED(bp))
+        return mm_guard_size(bp);
+#endif
+    return GET_SIZE(HDRP(bp)) - DSIZE;
+}
+
+#ifdef DEBUG
+/*
+ * size_matches - size is what bp was allocated or resized with, or its
+ *                usable size; place() never leaves MIN_BLKSIZE unsplit
+ */
+static int size_matches(void *bp, size_t size)
+{
+#ifdef MM_GUARD
+    if (mm_guard_threshold && IS_GUARDED(bp))
+        return size == mm_guard_size(bp);
+#endif
+    return size <= payload_size(bp) &&
+        GET_SIZE(HDRP(bp)) - adjust_size(size) < MIN_BLKSIZE;
+}
+#endif
+
+/*
+ * heap_sbrk / heap_hi - grow the heap, last byte of the heap
+ */
+static inline void *heap_sbrk(struct mm_heap *h, size_t incr)
+{
+#ifdef MM_REGIONS
+    return mm_region_sbrk(h->region, incr);
+#else
+    (void)h;
+    return mem_sbrk(incr);
+#endif
+}
+
+static inline char *heap_hi(struct mm_heap *h)
+{
+#ifdef MM_REGIONS
+    return h->region->brk - 1;
+#else
+    (void)h;
+    return mem_heap_hi();
+#endif
+}
+
+/*
+ * mm_init - Initialize the memory manager
+ */
+int mm_init(void)
+{
+#ifdef MM_GUARD
+    mm_guard_setup();
+#endif
+#if defined(MM_THREADS)
+    return arena_setup(1);
+#elif defined(MM_REGIONS)
+    handle_reset();
+    mm_region_release(&main_region);
+    if (mm_region_init(&main_region, MM_HEAP_RESERVE, -1, REGION_FLAGS) < 0)
+        return -1;
+    main_heap.region = &main_region;
+    return heap_init(&main_heap);
+#else
+    handle_reset();
+    return heap_init(&main_heap);
+#endif
+}
+
+/*
+ * malloc - Allocate a block with at least size bytes of payload
+ */
+void *malloc(size_t size)
+{
+    return alloc_block(size, 0);
+}
+
+/*
+ * mm_malloc_hint - malloc, from the long-lived pool for MM_HINT_LONG
+ */
+void *mm_malloc_hint(size_t size, int hint)
+{
+    return alloc_block(size, hint == MM_HINT_LONG ? POOL_BIT : 0);
+}
+
+/*
+ * alloc_block - Allocate a block from pool (a POOL_BIT value)
+ */
+static void *alloc_block(size_t size, mm_word_t pool)
+{
+#ifdef MM_THREADS
+    struct mm_arena *a;
+    void *bp;
+#endif
+
+#ifdef MM_GUARD
+    if (mm_guard_threshold && size >= mm_guard_threshold)
+        return mm_guard_alloc(size);
+#endif
+
+#ifdef MM_THREADS
+    if (size == 0 || (a = arena_get()) == NULL)
+        return NULL;
+
+    pthread_mutex_lock(&a->lock);
+    arena_drain(a);
+    bp = heap_malloc(&a->heap, size, pool);
+    pthread_mutex_unlock(&a->lock);
+    return bp;
+#else
+    return heap_malloc(&main_heap, size, pool);
+#endif
+}
+
+/*
+ * free - Free a block
+ */
+void free(void *bp)
+{
+#ifdef MM_GUARD
+    if (mm_guard_threshold && bp != NULL && IS_GUARDED(bp)) {
+        mm_guard_free(bp);
+        return;
+    }
+#endif
+    free_block(bp);
+}
+
+/*
+ * mm_free_sized - free, from a caller that knows the block's size
+ */
+void mm_free_sized(void *bp, size_t size)
+{
+    (void)size;
+    if (bp == NULL)
+        return;
+#ifdef DEBUG
+    if (!size_matches(bp, size)) {
+        fprintf(stderr, "Error: mm_free_sized(%p, %zu) on a block with %zu "
+                "payload bytes\n", bp, size, payload_size(bp));
+        abort();
+    }
+#endif
+
+#ifdef MM_GUARD
+    if (mm_guard_threshold && size >= mm_guard_threshold && IS_GUARDED(bp)) {
+        mm_guard_free(bp);
+        return;
+    }
+#endif
+    free_block(bp);
+}
+
+/*
+ * free_block - Free a block of the heaps, not a guarded one
+ */
+static void free_block(void *bp)
+{
+#ifdef MM_THREADS
+    struct mm_arena *a;
+
+    if (!bp)
+        return;
+
+    /* blocks of another node's arena, or of a busy one, go back lazily */
+    a = arena_of(bp);
+    if (a != arena_get() || pthread_mutex_trylock(&a->lock) != 0) {
+        arena_remote_free(a, bp);
+        return;
+    }
+
+    arena_drain(a);
+    heap_free(&a->heap, bp);
+    pthread_mutex_unlock(&a->lock);
+#else
+    heap_free(&main_heap, bp);
+#endif
+}
+
+/*
+ * realloc - resize in place when possible, otherwise move
+ */
+void *realloc(void *oldptr, size_t size)
+{
+    void *newptr;
+
+    dbg_printf("Calling mm_realloc........");
+
+    /* If size == 0 then this is just free, and we return NULL. */
+    if (size == 0) {
+        free(oldptr);
+        return NULL;
+    }
+
+    /* If oldptr is NULL, then this is just malloc. */
+    if (oldptr == NULL)
+        return malloc(size);
+
+    if (size > MAX_PAYLOAD) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if ((newptr = resize_in_place(oldptr, size)) != NULL)
+        return newptr;
+
+    newptr = alloc_block(size, GET_POOL(HDRP(oldptr)));
+
+    /* If realloc() fails the original block is left untouched  */
+    if (!newptr)
+        return NULL;
+
+    /* Copy the old payload. */
+    mm_memcpy(newptr, oldptr, MIN(size, payload_size(oldptr)));
+
+    /* Free the old block. */
+    free(oldptr);
+
+    return newptr;
+}
+
+/*
+ * resize_in_place - resize bp within its heap, NULL if it has to move
+ */
+static void *resize_in_place(void *bp, size_t size)
+{
+    void *newptr;
+
+#ifdef MM_GUARD
+    /* guarded blocks, and blocks growing into guarded sizes, move */
+    if (mm_guard_threshold && (IS_GUARDED(bp) || size >= mm_guard_threshold))
+        return NULL;
+#endif
+
+#ifdef MM_THREADS
+    {
+        struct mm_arena *a = arena_of(bp);
+
+        pthread_mutex_lock(&a->lock);
+        newptr = heap_resize(&a->heap, bp, size);
+        pthread_mutex_unlock(&a->lock);
+    }
+#else
+    newptr = heap_resize(&main_heap, bp, size);
+#endif
+    return newptr;
+}
+
+/*
+ * calloc - Allocate nmemb * size bytes and zero them
+ * This function is not tested by mdriver, but it is
+ * needed to run the traces.
+ */
+void *calloc(size_t nmemb, size_t size)
+{
+    size_t bytes = nmemb * size;
+    void *newptr;
+
+    if (nmemb && bytes / nmemb != size)
+        return NULL;
+
+    if ((newptr = malloc(bytes)) != NULL)
+        memset(newptr, 0, bytes);
+
+    return newptr;
+}
+
+/*
+ * mm_memalign - Allocate size bytes at a multiple of alignment, a power
+ *               of two; never a guarded block
+ */
+void *mm_memalign(size_t alignment, size_t size)
+{
+#ifdef MM_THREADS
+    struct mm_arena *a;
+#endif
+    void *bp;
+
+    if (alignment & (alignment - 1)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (alignment <= ALIGNMENT)
+        return alloc_block(size, 0);
+
+#ifdef MM_THREADS
+    if (size == 0 || (a = arena_get()) == NULL)
+        return NULL;
+
+    pthread_mutex_lock(&a->lock);
+    arena_drain(a);
+    bp = heap_memalign(&a->heap, alignment, size);
+    pthread_mutex_unlock(&a->lock);
+#else
+    bp = heap_memalign(&main_heap, alignment, size);
+#endif
+    return bp;
+}
+
+/*
+ * mm_usable_size - payload bytes of bp, at least what was asked for
+ */
+size_t mm_usable_size(void *bp)
+{
+    return bp ? payload_size(bp) : 0;
+}
+
+/*
+ * mm_heapsize - bytes the heaps have grown to
+ */
+size_t mm_heapsize(void)
+{
+#if defined(MM_THREADS)
+    size_t size = 0;
+
+    for (int i = 0; i < num_nodes; i++)
+        if (arenas[i].live)
+            size += arenas[i].region.brk - arenas[i].region.start;
+    return size;
+#elif defined(MM_REGIONS)
+    return main_region.brk - main_region.start;
+#else
+    return mem_heapsize();
+#endif
+}
+
+/*
+ * mm_checkheap - Check the heap for consistency
+ */
+void mm_checkheap(int verbose)
+{
+#ifdef MM_THREADS
+    for (int i = 0; i < num_nodes; i++) {
+        struct mm_arena *a = &arenas[i];
+
+        if (!a->live)
+            continue;
+        if (verbose)
+            printf("Arena %d%s:\n", i, simulated ? " (simulated)" : "");
+        pthread_mutex_lock(&a->lock);
+        arena_drain(a);
+        heap_check(&a->heap, verbose);
+        pthread_mutex_unlock(&a->lock);
+    }
+#else
+    heap_check(&main_heap, verbose);
+    handle_check(verbose);
+#endif
+}
+
+
+#ifndef MM_THREADS
+
+#define IMAGE_MAGIC     "mmheap1"
+
+/*
+ * Header at offset 0 of a heap image; the heap bytes follow at offset,
+ * on a page boundary so that they can be mapped straight from the file.
+ */
+struct mm_image {
+    char magic[8];
+    uint32_t wsize;         /* block format of the writer */
+    uint32_t alignment;
+    uint32_t num_freelist;
+    uint32_t offset;        /* file offset of the heap bytes */
+    uint64_t base;          /* address the heap started at */
+    uint64_t size;          /* heap bytes, up to and including the epilogue */
+    uint64_t root;          /* caller's entry block, 0 for none */
+};
+
+/*
+ * image_io - read or write all n bytes at file offset off
+ */
+static int image_io(int fd, void *buf, size_t n, off_t off, int writing)
+{
+    char *p = buf;
+
+    while (n > 0) {
+        ssize_t done = writing ? pwrite(fd, p, n, off) : pread(fd, p, n, off);
+
+        if (done < 0 && errno == EINTR)
+            continue;
+        if (done <= 0) {
+            if (done == 0)
+                errno = EIO;
+            return -1;
+        }
+        p += done;
+        off += done;
+        n -= done;
+    }
+    return 0;
+}
+
+/*
+ * mm_snapshot - write the heap and the root block to fd
+ */
+int mm_snapshot(int fd, void *root)
+{
+    struct mm_heap *h = &main_heap;
+    struct mm_image img;
+
+    if (root != NULL && !in_heap(h, root)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(&img, 0, sizeof(img));
+    memcpy(img.magic, IMAGE_MAGIC, sizeof(img.magic));
+    img.wsize = WSIZE;
+    img.alignment = ALIGNMENT;
+    img.num_freelist = NUM_LISTS;
+    img.offset = sysconf(_SC_PAGESIZE);
+    img.base = (uintptr_t)h->base;
+    img.size = heap_hi(h) + 1 - h->base;
+    img.root = (uintptr_t)root;
+
+    if (image_io(fd, &img, sizeof(img), 0, 1) < 0 ||
+        image_io(fd, h->base, img.size, img.offset, 1) < 0)
+        return -1;
+    /* drop the tail of an older, larger image */
+    return ftruncate(fd, img.offset + img.size);
+}
+
+/*
+ * mm_restore - replace the heap by the image in fd, at its old address.
+ *              A failure leaves the heap as it was, unless the heap
+ *              had to go first to make room for the image; then the
+ *              heap is fresh and empty, as mm_init leaves it.
+ */
+int mm_restore(int fd, void **rootp)
+{
+    struct mm_image img;
+    struct stat st;
+    char *base;
+    int gone = 0;       /* the old heap is given up */
+#ifdef MM_REGIONS
+    struct mm_region r;
+#endif
+
+    if (image_io(fd, &img, sizeof(img), 0, 0) < 0)
+        return -1;
+    if (memcmp(img.magic, IMAGE_MAGIC, sizeof(img.magic)) != 0 ||
+        img.wsize != WSIZE || img.alignment != ALIGNMENT ||
+        img.num_freelist != NUM_LISTS ||
+        img.offset % sysconf(_SC_PAGESIZE) != 0 || img.size < ROOTS_SIZE) {
+        errno = EINVAL;
+        return -1;
+    }
+    /* a mapping past the end of the file faults on first touch */
+    if (fstat(fd, &st) < 0)
+        return -1;
+    if ((uint64_t)st.st_size < img.offset + img.size) {
+        errno = EINVAL;
+        return -1;
+    }
+    base = (char *)(uintptr_t)img.base;
+
+#ifdef MM_REGIONS
+    if (img.size > MM_HEAP_RESERVE) {
+        errno = EINVAL;
+        return -1;
+    }
+    /* map the image beside the heap, so a failure costs nothing */
+    if (mm_region_init_at(&r, base, MM_HEAP_RESERVE, -1, REGION_FLAGS) < 0) {
+        if (errno != EEXIST || base >= main_region.end ||
+            base + MM_HEAP_RESERVE <= main_region.start)
+            return -1;
+        /* the heap is in the way, e.g. the image came from this run */
+        mm_region_release(&main_region);
+        gone = 1;
+        if (mm_region_init_at(&r, base, MM_HEAP_RESERVE, -1,
+                              REGION_FLAGS) < 0)
+            goto fail;
+    }
+    if (mm_region_map_file(&r, fd, img.offset, img.size) == (void *)-1) {
+        mm_region_release(&r);
+        goto fail;
+    }
+    mm_region_release(&main_region);
+    main_region = r;
+    main_heap.region = &main_region;
+#else
+    /* the memlib heap cannot move, it has to be where the image was */
+    if ((char *)mem_heap_lo() != base) {
+        errno = EADDRNOTAVAIL;
+        return -1;
+    }
+    mem_reset_brk();
+    gone = 1;
+    if (mem_sbrk(img.size) == (void *)-1 ||
+        image_io(fd, base, img.size, img.offset, 0) < 0)
+        goto fail;
+#endif
+
+    /* the table is not in the image, handles do not survive it */
+    handle_reset();
+    main_heap.base = base;
+    main_heap.roots = base + HEAP_PAD + WSIZE;
+    if (rootp != NULL)
+        *rootp = (void *)(uintptr_t)img.root;
+    return 0;
+
+fail:
+    if (gone) {
+        int err = errno;
+
+        /* an empty heap, not one pointing at what is no longer there */
+#ifndef MM_REGIONS
+        mem_reset_brk();
+#endif
+        mm_init();
+        errno = err;
+    }
+    return -1;
+}
+
+#else
+
+/*
+ * mm_snapshot / mm_restore - arenas live at addresses picked per run
+ *                            and per node; images are not supported
+ */
+int mm_snapshot(int fd, void *root)
+{
+    (void)fd;
+    (void)root;
+    errno = ENOTSUP;
+    return -1;
+}
+
+int mm_restore(int fd, void **rootp)
+{
+    (void)fd;
+    (void)rootp;
+    errno = ENOTSUP;
+    return -1;
+}
+
+#endif /* ndef MM_THREADS */
+
+
+#ifndef MM_THREADS
+
+/* a free slot holds the next free slot, tagged in the low bit */
+#define SLOT_FREE(p)    ((uintptr_t)(p) & 1)
+#define SLOT_LINK(i)    ((void *)(((uintptr_t)(i) << 1) | 1))
+#define SLOT_NEXT(p)    ((size_t)((uintptr_t)(p) >> 1))
+
+/*
+ * handle_reset - forget every handle, the heap is about to go
+ */
+static void handle_reset(void)
+{
+    handles = NULL;
+    num_handles = 0;
+    free_handle = 0;
+}
+
+/*
+ * handle_grow - double the handle table and chain the new slots
+ */
+static int handle_grow(void)
+{
+    size_t n = num_handles ? 2 * num_handles : 64;
+    void **table;
+
+    /* an ordinary block, so it never slides itself */
+    if ((table = realloc(handles, n * sizeof(void *))) == NULL)
+        return -1;
+    table[0] = NULL;
+    for (size_t i = n - 1; i >= MAX(num_handles, 1); i--) {
+        table[i] = SLOT_LINK(free_handle);
+        free_handle = i;
+    }
+    handles = table;
+    num_handles = n;
+    return 0;
+}
+
+/*
+ * handle_of - slot of bp if it is a handle block, else 0
+ */
+static inline size_t handle_of(void *bp)
+{
+    size_t id = GET(bp);
+
+    return id < num_handles && handles[id] == bp ? id : 0;
+}
+
+/*
+ * mm_halloc - Allocate size bytes reached through a handle, 0 if out
+ *             of memory
+ */
+mm_handle_t mm_halloc(size_t size)
+{
+    size_t id;
+    char *bp;
+
+    if (size == 0 || size > MAX_PAYLOAD - ALIGNMENT)
+        return 0;
+    if (free_handle == 0 && handle_grow() < 0)
+        return 0;
+    /* straight from the heap: a guarded block could not slide */
+    if ((bp = heap_malloc(&main_heap, size + ALIGNMENT, 0)) == NULL)
+        return 0;
+
+    id = free_handle;
+    free_handle = SLOT_NEXT(handles[id]);
+    handles[id] = bp;
+    PUT(bp, (mm_word_t)id);
+    return id;
+}
+
+/*
+ * mm_hderef - current address of the payload of handle h
+ */
+void *mm_hderef(mm_handle_t h)
+{
+    assert(h == 0 || (h < num_handles && !SLOT_FREE(handles[h])));
+    return h ? (char *)handles[h] + ALIGNMENT : NULL;
+}
+
+/*
+ * mm_hfree - Free the block of handle h and the handle
+ */
+void mm_hfree(mm_handle_t h)
+{
+    if (h == 0)
+        return;
+    assert(h < num_handles && !SLOT_FREE(handles[h]));
+    heap_free(&main_heap, handles[h]);
+    handles[h] = SLOT_LINK(free_handle);
+    free_handle = h;
+}
+
+/*
+ * slide_block - move handle block bp down into free block fp, its
+ *               predecessor; return the free block now behind it
+ */
+static void *slide_block(struct mm_heap *h, void *fp, void *bp)
+{
+    size_t fsize = GET_SIZE(HDRP(fp));
+    size_t bsize = GET_SIZE(HDRP(bp));
+    mm_word_t pool = GET_POOL(HDRP(bp));
+
+    delete_freenode(h, fp);
+    handles[handle_of(bp)] = fp;
+    memmove(fp, bp, bsize - DSIZE);
+    PUT(HDRP(fp), PACK(bsize, 1 | pool));
+    PUT(FTRP(fp), PACK(bsize, 1 | pool));
+
+    fp = NEXT_BLKP(fp);
+    PUT(HDRP(fp), PACK(fsize, pool));
+    PUT(FTRP(fp), PACK(fsize, pool));
+    return coalesce(h, fp);
+}
+
+/*
+ * mm_hcompact - slide handle blocks toward the heap start until at
+ *               least budget bytes moved (SIZE_MAX: as far as they go);
+ *               return the bytes moved
+ */
+size_t mm_hcompact(size_t budget)
+{
+    struct mm_heap *h = &main_heap;
+    size_t moved = 0;
+    char *bp, *next;
+
+    for (bp = NEXT_BLKP(getroot(h, NUM_LISTS - 1));
+         GET_SIZE(HDRP(bp)) > 0 && moved < budget; bp = NEXT_BLKP(bp)) {
+        if (GET_ALLOC(HDRP(bp)))
+            continue;
+        /* the free block moves up past every handle block behind it */
+        for (next = NEXT_BLKP(bp);
+             moved < budget && GET_SIZE(HDRP(next)) > 0 &&
+             GET_ALLOC(HDRP(next)) && handle_of(next) &&
+             GET_POOL(HDRP(next)) == GET_POOL(HDRP(bp));
+             next = NEXT_BLKP(bp)) {
+            moved += GET_SIZE(HDRP(next));
+            bp = slide_block(h, bp, next);
+        }
+    }
+    return moved;
+}
+
+/*
+ * handle_check - every live handle names an allocated block that
+ *                names it back
+ */
+static void handle_check(int verbose)
+{
+    size_t live = 0;
+
+    for (size_t i = 1; i < num_handles; i++) {
+        char *bp = handles[i];
+
+        if (SLOT_FREE(bp))
+            continue;
+        live++;
+        if (!in_heap(&main_heap, bp) || !GET_ALLOC(HDRP(bp)) || GET(bp) != i)
+            printf("Error: handle %zu does not match its block %p\n", i, bp);
+    }
+    if (verbose)
+        printf("Handles: %zu live of %zu\n", live, num_handles ? num_handles - 1 : 0);
+}
+
+#else
+
+/*
+ * mm_halloc, mm_hderef, mm_hfree, mm_hcompact - a block of an arena
+ *     can be in use by another thread while it would slide; handles
+ *     are not supported
+ */
+mm_handle_t mm_halloc(size_t size)
+{
+    (void)size;
+    errno = ENOTSUP;
+    return 0;
+}
+
+void *mm_hderef(mm_handle_t h)
+{
+    (void)h;
+    return NULL;
+}
+
+void mm_hfree(mm_handle_t h)
+{
+    (void)h;
+}
+
+size_t mm_hcompact(size_t budget)
+{
+    (void)budget;
+    return 0;
+}
+
+#endif /* ndef MM_THREADS */
+
+
+#ifdef MM_THREADS
+
+/*
+ * arena_setup - find the node count; with reset, drop all arenas first
+ */
+static int arena_setup(int reset)
+{
+    char *env = getenv("MM_NUMA_NODES");
+
+    pthread_mutex_lock(&arena_lock);
+    if (reset) {
+        for (int i = 0; i < MM_MAX_NODES; i++) {
+            struct mm_arena *a = &arenas[i];
+
+            if (!a->live)
+                continue;
+            mm_region_release(&a->region);
+            pthread_mutex_destroy(&a->lock);
+            memset(a, 0, sizeof(*a));
+        }
+        num_nodes = 0;
+    }
+
+    if (num_nodes == 0) {
+        int n;
+
+        simulated = env != NULL && atoi(env) > 0;
+        n = simulated ? atoi(env) : mm_numa_nodes();
+        __atomic_store_n(&num_nodes, MIN(MAX(n, 1), MM_MAX_NODES),
+                         __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&arena_lock);
+
+    /* after num_nodes is set: pthread_atfork may call malloc */
+    pthread_once(&atfork_once, arena_atfork);
+    return 0;
+}
+
+/*
+ * arena_get - arena of the node the calling thread runs on, created
+ *             by that thread on first use so its pages are local
+ */
+static struct mm_arena *arena_get(void)
+{
+    struct mm_arena *a;
+    unsigned cpu, node;
+
+    if (__atomic_load_n(&num_nodes, __ATOMIC_ACQUIRE) == 0)
+        arena_setup(0);
+
+    mm_getcpu(&cpu, &node);
+    a = &arenas[(simulated ? cpu : node) % num_nodes];
+    if (__atomic_load_n(&a->live, __ATOMIC_ACQUIRE))
+        return a;
+
+    pthread_mutex_lock(&arena_lock);
+    if (!a->live) {
+        int id = a - arenas;
+
+        if (mm_region_init(&a->region, MM_HEAP_RESERVE,
+                           simulated ? -1 : id, REGION_FLAGS) < 0) {
+            pthread_mutex_unlock(&arena_lock);
+            return NULL;
+        }
+        a->heap.region = &a->region;
+        if (heap_init(&a->heap) < 0) {
+            mm_region_release(&a->region);
+            pthread_mutex_unlock(&arena_lock);
+            return NULL;
+        }
+        pthread_mutex_init(&a->lock, NULL);
+        a->remote = NULL;
+        __atomic_store_n(&a->live, 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&arena_lock);
+    return a;
+}
+
+/*
+ * arena_of - arena whose region holds block bp
+ */
+static struct mm_arena *arena_of(void *bp)
+{
+    for (int i = 0; i < num_nodes; i++) {
+        struct mm_arena *a = &arenas[i];
+
+        if ((char *)bp >= a->region.start && (char *)bp < a->region.end)
+            return a;
+    }
+    assert(0);
+    return NULL;
+}
+
+/*
+ * arena_remote_free - push bp onto the remote list of its owner
+ */
+static void arena_remote_free(struct mm_arena *a, void *bp)
+{
+    void *head = __atomic_load_n(&a->remote, __ATOMIC_RELAXED);
+
+    do {
+        *(void **)bp = head;
+    } while (!__atomic_compare_exchange_n(&a->remote, &head, bp, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/*
+ * arena_drain - free the whole remote list in one batch, a->lock held
+ */
+static void arena_drain(struct mm_arena *a)
+{
+    void *bp, *next;
+
+    if (__atomic_load_n(&a->remote, __ATOMIC_RELAXED) == NULL)
+        return;
+
+    /* only the lock holder pops, and it takes everything: no ABA */
+    bp = __atomic_exchange_n(&a->remote, NULL, __ATOMIC_ACQUIRE);
+    for (; bp != NULL; bp = next) {
+        next = *(void **)bp;
+        heap_free(&a->heap, bp);
+    }
+}
+
+/*
+ * arena_prefork - take every allocator lock, in the order malloc does,
+ *                 so no other thread is inside the allocator at fork
+ */
+static void arena_prefork(void)
+{
+    pthread_mutex_lock(&arena_lock);
+    for (int i = 0; i < MM_MAX_NODES; i++)
+        if (arenas[i].live)
+            pthread_mutex_lock(&arenas[i].lock);
+#ifdef MM_GUARD
+    mm_guard_lock();
+#endif
+}
+
+/*
+ * arena_postfork_parent - release what arena_prefork took
+ */
+static void arena_postfork_parent(void)
+{
+#ifdef MM_GUARD
+    mm_guard_unlock();
+#endif
+    for (int i = MM_MAX_NODES - 1; i >= 0; i--)
+        if (arenas[i].live)
+            pthread_mutex_unlock(&arenas[i].lock);
+    pthread_mutex_unlock(&arena_lock);
+}
+
+/*
+ * arena_postfork_child - the child has only the forking thread, which
+ *                        holds every lock; start it with fresh ones
+ */
+static void arena_postfork_child(void)
+{
+#ifdef MM_GUARD
+    mm_guard_unlock();
+#endif
+    for (int i = 0; i < MM_MAX_NODES; i++)
+        if (arenas[i].live)
+            pthread_mutex_init(&arenas[i].lock, NULL);
+    pthread_mutex_init(&arena_lock, NULL);
+}
+
+/*
+ * arena_atfork - register the fork handlers, once
+ */
+static void arena_atfork(void)
+{
+    pthread_atfork(arena_prefork, arena_postfork_parent, arena_postfork_child);
+}
+
+#endif /* def MM_THREADS */
+
+
+/*
+ * heap_init - lay out the seglist roots and the first free chunk
+ * segregated list - save each root at beginning, each root is MIN_BLKSIZE
+ */
+static int heap_init(struct mm_heap *h)
+{
+    char *p;
+
+    /* create the initial empty heap */
+    if ((p = heap_sbrk(h, ROOTS_SIZE)) == (void *)-1)
+        return -1;
+    h->base = p;
+    h->roots = p + HEAP_PAD + WSIZE;
+    memset(p, 0, HEAP_PAD);                             /* alignment padding */
+
+    for (int i = 0; i < NUM_LISTS; i++) {
+        char *root = getroot(h, i);
+        PUT(HDRP(root), PACK(MIN_BLKSIZE, 1));          /* prologue header */
+        mm_link_put(h->base, NEXT_LINKP(root), NULL);   /* root next free node */
+        mm_link_put(h->base, PREV_LINKP(root), NULL);   /* root prev free node */
+        PUT(FTRP(root), PACK(MIN_BLKSIZE, 1));          /* prologue footer */
+    }
+    PUT(p + ROOTS_SIZE - WSIZE, PACK(0, 1));            /* epilogue header */
+
+    /* Extend the empty heap with a free block of CHUNKSIZE bytes */
+    if (extend_heap(h, CHUNKSIZE/WSIZE, 0) == NULL)
+        return -1;
+    return 0;
+}
+
+/*
+ * heap_malloc - Allocate a block with at least size bytes of payload
+ *               from the free space of pool
+ */
+static void *heap_malloc(struct mm_heap *h, size_t size, mm_word_t pool)
+{
+    size_t asize;      /* adjusted block size */
+    size_t extendsize; /* amount to extend heap if no fit */
+    char *bp;
+
+    dbg_printf("Calling mm_malloc........");
+
+    /* Ignore spurious requests */
+    if (size == 0)
+        return NULL;
+    if (size > MAX_PAYLOAD) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    /* Adjust block size to include overhead and alignment reqs. */
+    asize = adjust_size(size);
+
+    /* Search the free list for a fit */
+    if ((bp = find_fit(h, asize, pool)) != NULL) {
+        place(h, bp, asize);
+        return bp;
+    }
+
+    /* No fit found. Get more memory and place the block */
+    extendsize = MAX(asize, CHUNKSIZE);
+    if ((bp = extend_heap(h, extendsize/WSIZE, pool)) == NULL)
+        return NULL;
+    place(h, bp, asize);
+    return bp;
+}
+
+/*
+ * heap_memalign - Allocate with room for an aligned block and a free
+ *                 lead in front of it, give the lead back, trim the tail
+ */
+static void *heap_memalign(struct mm_heap *h, size_t alignment, size_t size)
+{
+    char *bp, *abp;
+    size_t csize, lead;
+
+    if (size == 0)
+        return NULL;
+    if (size > MAX_PAYLOAD / 2 || alignment > MAX_PAYLOAD / 2) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if ((bp = heap_malloc(h, size + alignment + MIN_BLKSIZE, 0)) == NULL)
+        return NULL;
+    if ((size_t)bp % alignment == 0)
+        return heap_resize(h, bp, size);
+
+    /* the lead has to be a block of its own, so at least MIN_BLKSIZE */
+    abp = (char *)(((size_t)bp + MIN_BLKSIZE + alignment - 1) & ~(alignment - 1));
+    lead = abp - bp;
+    csize = GET_SIZE(HDRP(bp));
+
+    PUT(HDRP(abp), PACK(csize - lead, 1));
+    PUT(FTRP(abp), PACK(csize - lead, 1));
+    PUT(HDRP(bp), PACK(lead, 1));
+    PUT(FTRP(bp), PACK(lead, 1));
+    heap_free(h, bp);
+
+    return heap_resize(h, abp, size);
+}
+
+/*
+ * heap_free - Free a block
+ */
+static void heap_free(struct mm_heap *h, void *bp)
+{
+    size_t size;
+    mm_word_t pool;
+
+    dbg_printf("Calling mm_free........");
+    if (!bp)
+        return;
+    size = GET_SIZE(HDRP(bp));
+    pool = GET_POOL(HDRP(bp));
+
+    PUT(HDRP(bp), PACK(size, pool));
+    PUT(FTRP(bp), PACK(size, pool));
+    coalesce(h, bp);
+}
+
+/*
+ * heap_resize - resize block bp in place; NULL if it has to move
+ */
+static void *heap_resize(struct mm_heap *h, void *bp, size_t size)
+{
+    size_t oldsize = GET_SIZE(HDRP(bp));
+    size_t asize = adjust_size(size);
+    mm_word_t pool = GET_POOL(HDRP(bp));
+
+    /* smaller than the old block: split off the tail */
+    if (asize <= oldsize) {
+        place(h, bp, asize);
+        return bp;
+    }
+
+    /* enough space in next free block of the same pool */
+    if (!GET_ALLOC(HDRP(NEXT_BLKP(bp))) && GET_POOL(HDRP(NEXT_BLKP(bp))) == pool) {
+        size_t nsize = GET_SIZE(HDRP(NEXT_BLKP(bp))) + oldsize;
+
+        if (nsize >= asize) {
+            delete_freenode(h, NEXT_BLKP(bp));
+            PUT(HDRP(bp), PACK(nsize, 1 | pool));
+            PUT(FTRP(bp), PACK(nsize, 1 | pool));
+            place(h, bp, asize);
+            return bp;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * heap_check - Check one heap for consistency
+ */
+static void heap_check(struct mm_heap *h, int verbose)
+{
+    char *bp;
+    int free_block_flag = 0;
+    int free_block_count = 0;
+
+    if (verbose)
+        printf("Heap (%p):\n", h->base);
+
+    // check prologue blocks
+    for (int i = 0; i < NUM_LISTS; i++) {
+        char *root = getroot(h, i);
+        if ((GET_SIZE(HDRP(root)) != MIN_BLKSIZE) || !GET_ALLOC(HDRP(root)))
+            printf("Bad prologue header for class %d\n", i);
+        checkblock(h, root);
+    }
+
+    for (bp = NEXT_BLKP(getroot(h, NUM_LISTS - 1)); GET_SIZE(HDRP(bp)) > 0;
+         bp = NEXT_BLKP(bp)) {
+        if (verbose)
+            printblock(h, bp);
+        checkblock(h, bp);
+
+        // check coalescing, free blocks of different pools stay apart
+        if (!GET_ALLOC(HDRP(bp))) {
+            if (free_block_flag == 1 && GET_POOL(HDRP(PREV_BLKP(bp))) == GET_POOL(HDRP(bp)))
+                printf("Error: consecutive free blocks %p | %p in the heap.\n",
+                       PREV_BLKP(bp), bp);
+            free_block_flag = 1;
+            free_block_count++;
+        } else {
+            free_block_flag = 0;
+        }
+    }
+
+    if (verbose)
+        printblock(h, bp);
+
+    // check epilogue block
+    if ((GET_SIZE(HDRP(bp)) != 0) || !(GET_ALLOC(HDRP(bp))))
+        printf("Bad epilogue header\n");
+
+    // check heap boundaries
+    if (bp - 1 != heap_hi(h))
+        printf("Error: heap end point %p is not equaled to heap high boundary %p\n",
+               bp - 1, heap_hi(h));
+
+    if (verbose)
+        printfreelist(h);
+    checkfreelist(h, free_block_count);
+}
+
+
+/* The remaining routines are internal helper routines */
+
+/*
+ * getclass - Get class for given size. Generated classes are a table
+ *            lookup for small sizes; default classes double from 4 * DSIZE
+ */
+static int getclass(size_t size)
+{
+#ifdef MM_CLASSES
+    int class;
+
+    if (size <= CLASS_TABLE_MAX)
+        return class_table[size / ALIGNMENT];
+    for (class = class_table[CLASS_TABLE_MAX / ALIGNMENT];
+         class < NUM_FREELIST - 1 && size > class_limit[class]; class++)
+        ;
+    return class;
+#else
+    size_t limit = 4 * DSIZE;
+    int class = 0;
+
+    while (class < NUM_FREELIST - 1 && size > limit) {
+        limit <<= 1;
+        class++;
+    }
+    return class;
+#endif
+}
+
+/*
+ * extend_heap - Extend heap with free block of pool and return its
+ *               block pointer
+ */
+static void *extend_heap(struct mm_heap *h, size_t words, mm_word_t pool)
+{
+    void *bp;
+    size_t size;
+
+    /* Round up to a whole number of aligned units */
+    size = ALIGN(words * WSIZE);
+    if ((bp = heap_sbrk(h, size)) == (void *)-1)
+        return NULL;
+
+    /* Initialize free block header/footer and the epilogue header */
+    PUT(HDRP(bp), PACK(size, pool));      /* free block header */
+    PUT(FTRP(bp), PACK(size, pool));      /* free block footer */
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* new epilogue header */
+
+    /* Coalesce if the previous block was free, in the same pool */
+    return coalesce(h, bp);
+}
+
+/*
+ * delete_freenode - delete the block from free list when it is allocated
+ */
+static void delete_freenode(struct mm_heap *h, void *bp)
+{
+    void *next = next_free_blck(h, bp);
+    void *prev = prev_free_blck(h, bp);
+
+    mm_link_put(h->base, NEXT_LINKP(prev), next);
+    if (next != NULL)
+        mm_link_put(h->base, PREV_LINKP(next), prev);
+}
+
+/*
+ * insert_freenode - insert the freed block to the list of its class
+ */
+static void insert_freenode(struct mm_heap *h, void *bp)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+    void *prevp = getroot(h, getlist(size, GET_POOL(HDRP(bp))));
+    void *nextp = next_free_blck(h, prevp);
+
+#if MM_ORDER == MM_ORDER_SIZE
+    for (; nextp != NULL && (prefetch_blck(next_free_blck(h, nextp), 0),
+                             GET_SIZE(HDRP(nextp)) < size);
+         prevp = nextp, nextp = next_free_blck(h, nextp))
+        ;
+#elif MM_ORDER == MM_ORDER_ADDR
+    for (; nextp != NULL && (char *)nextp < (char *)bp;
+         prevp = nextp, nextp = next_free_blck(h, nextp))
+        ;
+#endif
+
+    mm_link_put(h->base, NEXT_LINKP(bp), nextp);
+    mm_link_put(h->base, PREV_LINKP(bp), prevp);
+    mm_link_put(h->base, NEXT_LINKP(prevp), bp);
+    if (nextp != NULL)
+        mm_link_put(h->base, PREV_LINKP(nextp), bp);
+}
+
+/*
+ * place - Place block of asize bytes at start of block bp and split if
+ *         remainder would be at least minimum block size. bp is either
+ *         a free block or, from realloc, an allocated one being resized.
+ */
+static void place(struct mm_heap *h, void *bp, size_t asize)
+{
+    size_t csize = GET_SIZE(HDRP(bp));
+    int is_realloc = GET_ALLOC(HDRP(bp));
+    mm_word_t pool = GET_POOL(HDRP(bp));
+
+    if (!is_realloc)
+        delete_freenode(h, bp);
+
+    if ((csize - asize) >= MIN_BLKSIZE) {
+        PUT(HDRP(bp), PACK(asize, 1 | pool));
+        PUT(FTRP(bp), PACK(asize, 1 | pool));
+        dbg_printblock(h, bp);
+
+        bp = NEXT_BLKP(bp);
+        PUT(HDRP(bp), PACK(csize-asize, pool));
+        PUT(FTRP(bp), PACK(csize-asize, pool));
+        /* a shrinking realloc may leave the tail next to a free block */
+        coalesce(h, bp);
+    }
+    else {
+        PUT(HDRP(bp), PACK(csize, 1 | pool));
+        PUT(FTRP(bp), PACK(csize, 1 | pool));
+    }
+}
+
+/*
+ * find_fit - Find a fit for a block with asize bytes in pool
+ */
+static void *find_fit(struct mm_heap *h, size_t asize, mm_word_t pool)
+{
+    int last = getlist(0, pool) + NUM_FREELIST;
+    void *bp, *next;
+
+    dbg_printf("FINDING FIT: ");
+    for (int i = getlist(asize, pool); i < last; i++) {
+#if MM_FIT == MM_FIT_BEST
+        void *best = NULL;
+
+        for (bp = next_free_blck(h, getroot(h, i)); bp != NULL; bp = next) {
+            size_t bsize = GET_SIZE(HDRP(bp));
+
+            next = next_free_blck(h, bp);
+            prefetch_blck(next, 0);
+            if (asize <= bsize && (best == NULL || bsize < GET_SIZE(HDRP(best)))) {
+                best = bp;
+                if (bsize == asize)
+                    break;
+            }
+        }
+        if (best != NULL) {
+            dbg_printf("FOUND!\n");
+            return best;
+        }
+#else
+        /* first fit search, the next candidate loads while this one is tested */
+        for (bp = next_free_blck(h, getroot(h, i)); bp != NULL; bp = next) {
+            next = next_free_blck(h, bp);
+            prefetch_blck(next, 0);
+            dbg_printf(" %lx > ", (long)bp);
+            if (asize <= GET_SIZE(HDRP(bp))) {
+                dbg_printf("FOUND!\n");
+                return bp;
+            }
+        }
+#endif
+    }
+
+    dbg_printf("NOT FOUND :(\n");
+    return NULL; /* no fit */
+}
+
+/*
+ * coalesce - boundary tag coalescing. Return ptr to coalesced block
+ */
+static void *coalesce(struct mm_heap *h, void *bp)
+{
+    mm_word_t pool = GET_POOL(HDRP(bp));
+    /* a free neighbour of the other pool counts as allocated */
+    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp))) ||
+        GET_POOL(FTRP(PREV_BLKP(bp))) != pool;
+    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp))) ||
+        GET_POOL(HDRP(NEXT_BLKP(bp))) != pool;
+    size_t size = GET_SIZE(HDRP(bp));
+
+    /* unlinking a neighbour writes to its list neighbours */
+    if (!prev_alloc) {
+        prefetch_blck(next_free_blck(h, PREV_BLKP(bp)), 1);
+        prefetch_blck(prev_free_blck(h, PREV_BLKP(bp)), 1);
+    }
+    if (!next_alloc) {
+        prefetch_blck(next_free_blck(h, NEXT_BLKP(bp)), 1);
+        prefetch_blck(prev_free_blck(h, NEXT_BLKP(bp)), 1);
+    }
+
+    dbg_printblock(h, bp);
+    if (prev_alloc && next_alloc) {            /* Case 1 */
+        /* nothing to merge */
+    }
+
+    else if (prev_alloc && !next_alloc) {      /* Case 2 */
+        size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
+        delete_freenode(h, NEXT_BLKP(bp));
+        PUT(HDRP(bp), PACK(size, pool));
+        PUT(FTRP(bp), PACK(size, pool));
+    }
+
+    else if (!prev_alloc && next_alloc) {      /* Case 3 */
+        size += GET_SIZE(HDRP(PREV_BLKP(bp)));
+        delete_freenode(h, PREV_BLKP(bp));
+        PUT(FTRP(bp), PACK(size, pool));
+        PUT(HDRP(PREV_BLKP(bp)), PACK(size, pool));
+        bp = PREV_BLKP(bp);
+    }
+
+    else {                                     /* Case 4 */
+        size += GET_SIZE(HDRP(PREV_BLKP(bp))) +
+            GET_SIZE(FTRP(NEXT_BLKP(bp)));
+        delete_freenode(h, PREV_BLKP(bp));
+        delete_freenode(h, NEXT_BLKP(bp));
+        PUT(HDRP(PREV_BLKP(bp)), PACK(size, pool));
+        PUT(FTRP(NEXT_BLKP(bp)), PACK(size, pool));
+        bp = PREV_BLKP(bp);
+    }
+
+    insert_freenode(h, bp);
+    return bp;
+}
+
+/*
+ * printblock - print the header, footer and links of each block
+ */
+static void printblock(struct mm_heap *h, void *bp)
+{
+    size_t hsize, halloc, fsize, falloc;
+
+    hsize = GET_SIZE(HDRP(bp));
+    halloc = GET_ALLOC(HDRP(bp));
+
+    if (hsize == 0) {
+        printf("%p: EOL\n", bp);
+        return;
+    }
+
+    fsize = GET_SIZE(FTRP(bp));
+    falloc = GET_ALLOC(FTRP(bp));
+
+    if (!halloc) {
+        printf("%p: header: [%zu:%c] next: %p prev: %p footer: [%zu:%c]\n", bp,
+               hsize, (halloc ? 'a' : 'f'),
+               next_free_blck(h, bp), prev_free_blck(h, bp),
+               fsize, (falloc ? 'a' : 'f'));
+    } else {
+        printf("%p: header: [%zu:%c] footer: [%zu:%c]\n", bp,
+               hsize, (halloc ? 'a' : 'f'), fsize, (falloc ? 'a' : 'f'));
+    }
+}
+
+/*
+ * printfreelist - print each free list
+ */
+static void printfreelist(struct mm_heap *h)
+{
+    for (int i = 0; i < NUM_LISTS; i++) {
+        printf("Free list %d: ", i);
+        for (char *bp = next_free_blck(h, getroot(h, i)); bp != NULL;
+             bp = next_free_blck(h, bp))
+            printf(" %p -> ", bp);
+        printf("END\n");
+    }
+}
+
+/*
+ * checkblock - check alignment, minimum size requirement,
+ *              and consistency of header and footer
+ */
+static void checkblock(struct mm_heap *h, void *bp)
+{
+    (void)h;
+    if (!aligned(bp))
+        printf("Error: %p is not aligned\n", bp);
+    if (GET_SIZE(HDRP(bp)) < MIN_BLKSIZE || GET_SIZE(HDRP(bp)) % ALIGNMENT)
+        printf("Error: %p has bad size %zu\n", bp, GET_SIZE(HDRP(bp)));
+    if (GET(HDRP(bp)) != GET(FTRP(bp)))
+        printf("Error: %p header does not match footer\n", bp);
+}
+
+/*
+ * checkfreelist - check the free list
+ */
+static void checkfreelist(struct mm_heap *h, int freeblockcount)
+{
+    int free_count = 0;
+
+    for (int i = 0; i < NUM_LISTS; i++) {
+        char *prev = getroot(h, i);
+        char *bp = next_free_blck(h, prev);
+
+        for (; bp != NULL; prev = bp, bp = next_free_blck(h, bp), free_count++) {
+            // check pointers in heap boundaries
+            if (!in_heap(h, bp)) {
+                printf("Error: free block %p not in heap\n", bp);
+                break;
+            }
+            // check pointer consistency
+            if (prev_free_blck(h, bp) != prev)
+                printf("Error: pointers not consistent at %p\n", bp);
+            if (GET_ALLOC(HDRP(bp)))
+                printf("Error: allocated block %p in free list %d\n", bp, i);
+            // check if block falls in the right pool and size class
+            if (getlist(GET_SIZE(HDRP(bp)), GET_POOL(HDRP(bp))) != i)
+                printf("Error: block %p not in its bucket %d\n", bp, i);
+        }
+    }
+
+    // check if free counts match
+    if (free_count != freeblockcount)
+        printf("Error: free count not matched: %d vs %d\n", freeblockcount, free_count);
+}
+
+/*
+ * Return whether the pointer is in the heap.
+ * May be useful for debugging.
+ */
+static int in_heap(struct mm_heap *h, const void *p)
+{
+    return (char *)p <= heap_hi(h) && (char *)p >= h->base;
+}
+
+/*
+ * Return whether the pointer is aligned.
+ * May be useful for debugging.
+ */
+static int aligned(const void *p)
+{
+    return (size_t)ALIGN(p) == (size_t)p;
+}
@@ -0,0 +1,65 @@
+/*
+ * mm_ext.h - interface mm_core.c offers on top of mm.h
+ */
+#ifndef __MM_EXT_H__
+#define __MM_EXT_H__
+
+#include <stddef.h>
+
+/*
+ * Heap images: write the whole heap to fd, and map it back later, in
+ * this or another process, at the address it was written from. root
+ * is a block the caller finds its data from; it comes back from
+ * mm_restore. Both return 0 on success, -1 with errno set. A failed
+ * mm_restore keeps the heap, or, if the image was to go where the heap
+ * is, leaves an empty one as mm_init does.
+ */
+int mm_snapshot(int fd, void *root);
+int mm_restore(int fd, void **rootp);
+
+/*
+ * Lifetime hints: malloc, with a guess at how long the block lives.
+ * With -DMM_HINTS long-lived blocks come from space of their own; in
+ * other builds the hint is ignored.
+ */
+#define MM_HINT_NONE    0   /* no idea, same as malloc */
+#define MM_HINT_SHORT   1   /* freed soon, e.g. at the end of a request */
+#define MM_HINT_LONG    2   /* kept around, e.g. a cache entry */
+
+void *mm_malloc_hint(size_t size, int hint);
+
+/*
+ * The rest of the malloc family, for mm_preload.c. mm_memalign takes
+ * any power of two; mm_usable_size is the payload bp really has, 0 for
+ * NULL, and a growable buffer may use all of it before it reallocs.
+ * mm_free_sized takes the size bp was allocated with, or its usable
+ * size; -DDEBUG builds abort on any other.
+ */
+void *mm_memalign(size_t alignment, size_t size);
+size_t mm_usable_size(void *bp);
+void mm_free_sized(void *bp, size_t size);
+
+/*
+ * Bytes the heaps have grown to, summed over all of them: what
+ * mem_heapsize says in a single heap build, the region breaks in
+ * MM_THREADS and MM_HUGEPAGE builds, which never call mem_sbrk.
+ */
+size_t mm_heapsize(void);
+
+/*
+ * Handles: a block reached through a handle instead of a pointer, so
+ * the allocator may move it. mm_hcompact slides handle blocks toward
+ * the heap start, moving at least budget bytes if it can (SIZE_MAX for
+ * all), and returns the bytes it moved; call it when a long-running
+ * program is idle. A pointer from mm_hderef stays good until the next
+ * mm_hcompact. Single heap builds only, mm_halloc fails with ENOTSUP
+ * under MM_THREADS.
+ */
+typedef size_t mm_handle_t;     /* 0 is no handle */
+
+mm_handle_t mm_halloc(size_t size);
+void *mm_hderef(mm_handle_t h);
+void mm_hfree(mm_handle_t h);
+size_t mm_hcompact(size_t budget);
+
+#endif /* __MM_EXT_H__ */
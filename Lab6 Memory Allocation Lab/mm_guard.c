@@ -0,0 +1,164 @@
+/*
+ * mm_guard.c - guarded mappings for large blocks
+ *
+ * A guarded block of size bytes is its own private mapping:
+ *
+ *  map                                              guard      map+len
+ *   ------------------------------------------------------------------
+ *  | unused | tag | hdr |         payload           | PROT_NONE page |
+ *   ------------------------------------------------------------------
+ *                       bp
+ *
+ * The payload is ALIGN(size) bytes, so it ends exactly at the guard
+ * page whenever size is a multiple of ALIGNMENT; otherwise up to
+ * ALIGNMENT-1 bytes of overrun go unnoticed. The tag in front of the
+ * header remembers the mapping. hdr carries ALLOC_BIT | GUARD_BIT, which
+ * is all the allocator needs to send the block back here on free.
+ *
+ * On free the whole mapping becomes PROT_NONE and joins a FIFO
+ * quarantine; the oldest quarantined mapping is unmapped once the
+ * quarantine is full.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "mm_guard.h"
+
+/* max freed blocks held back (MM_GUARD_QUARANTINE may ask for fewer) */
+#define QUARANTINE_MAX  1024
+
+#define ROUNDUP(x, a)   (((size_t)(x) + ((a)-1)) & ~(size_t)((a)-1))
+#define ROUNDDOWN(x, a) ((size_t)(x) & ~(size_t)((a)-1))
+
+/* What a guarded block needs to know about its mapping */
+struct guard_tag {
+    char *map;      /* start of the mapping */
+    size_t len;     /* bytes mapped, guard page included */
+    size_t size;    /* requested payload size */
+};
+
+size_t mm_guard_threshold;
+
+static struct {
+    char *map;
+    size_t len;
+} quarantine[QUARANTINE_MAX];
+static int q_max = 64;          /* quarantine capacity */
+static int q_head, q_len;       /* oldest entry, entries in use */
+static char q_lock;             /* spin lock over the quarantine */
+
+/*
+ * tagp - tag of guarded block bp, the words just in front of its header
+ */
+static inline struct guard_tag *tagp(void *bp)
+{
+    return (struct guard_tag *)ROUNDDOWN(HDRP(bp) - sizeof(struct guard_tag),
+                                         sizeof(void *));
+}
+
+/*
+ * mm_guard_setup - switch the mode on if MM_GUARD asks for it, from
+ *                  mm_init before any other thread allocates
+ */
+void mm_guard_setup(void)
+{
+    char *env;
+
+    /* a new heap starts with an empty quarantine */
+    for (; q_len > 0; q_len--, q_head = (q_head + 1) % q_max)
+        munmap(quarantine[q_head].map, quarantine[q_head].len);
+    q_head = 0;
+
+    mm_guard_threshold = 0;
+    if ((env = getenv("MM_GUARD")) != NULL)
+        mm_guard_threshold = strtoul(env, NULL, 0);
+    if ((env = getenv("MM_GUARD_QUARANTINE")) != NULL) {
+        q_max = atoi(env);
+        if (q_max < 0)
+            q_max = 0;
+        if (q_max > QUARANTINE_MAX)
+            q_max = QUARANTINE_MAX;
+    }
+}
+
+/*
+ * mm_guard_alloc - map a block whose payload ends at a guard page
+ */
+void *mm_guard_alloc(size_t size)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t data = ROUNDUP(ALIGN(size) + WSIZE + sizeof(struct guard_tag)
+                          + sizeof(void *), page);
+    size_t len = data + page;
+    struct guard_tag *tag;
+    char *map, *bp;
+
+    map = mmap(NULL, len, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED)
+        return NULL;
+    if (mprotect(map + data, page, PROT_NONE) < 0) {
+        munmap(map, len);
+        return NULL;
+    }
+
+    bp = map + data - ALIGN(size);
+    PUT(HDRP(bp), PACK(0, ALLOC_BIT | GUARD_BIT));
+    tag = tagp(bp);
+    tag->map = map;
+    tag->len = len;
+    tag->size = size;
+    return bp;
+}
+
+/*
+ * mm_guard_free - fence off bp and quarantine it; a second free of the
+ *                 same block faults on the tag
+ */
+void mm_guard_free(void *bp)
+{
+    struct guard_tag tag = *tagp(bp);
+
+    if (q_max == 0) {
+        munmap(tag.map, tag.len);
+        return;
+    }
+    mprotect(tag.map, tag.len, PROT_NONE);
+
+    mm_guard_lock();
+    if (q_len == q_max) {
+        munmap(quarantine[q_head].map, quarantine[q_head].len);
+        q_head = (q_head + 1) % q_max;
+        q_len--;
+    }
+    quarantine[(q_head + q_len) % q_max].map = tag.map;
+    quarantine[(q_head + q_len) % q_max].len = tag.len;
+    q_len++;
+    mm_guard_unlock();
+}
+
+/*
+ * mm_guard_lock / mm_guard_unlock - the quarantine lock, also taken
+ *                                   around fork by the threaded build
+ */
+void mm_guard_lock(void)
+{
+    while (__atomic_test_and_set(&q_lock, __ATOMIC_ACQUIRE))
+        ;
+}
+
+void mm_guard_unlock(void)
+{
+    __atomic_clear(&q_lock, __ATOMIC_RELEASE);
+}
+
+/*
+ * mm_guard_size - payload size bp was allocated with
+ */
+size_t mm_guard_size(void *bp)
+{
+    return tagp(bp)->size;
+}
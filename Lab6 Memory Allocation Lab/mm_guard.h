@@ -0,0 +1,42 @@
+/*
+ * mm_guard.h - guarded mappings for large blocks (debug builds)
+ *
+ * With MM_GUARD=bytes in the environment, every block of at least that
+ * many bytes gets a mapping of its own, laid out so that its payload
+ * ends right where a PROT_NONE guard page starts. Writing past the end
+ * faults on the spot instead of corrupting the next block's header and
+ * turning up much later in coalesce. A freed guarded block stays
+ * mapped PROT_NONE in a quarantine of MM_GUARD_QUARANTINE blocks, so a
+ * use after free faults as well, before its addresses are given back.
+ */
+#ifndef __MM_GUARD_H__
+#define __MM_GUARD_H__
+
+#include <stddef.h>
+
+#include "mm_block.h"
+
+/* Header flag of a guarded block; heap blocks never have it set */
+#define GUARD_BIT       ((mm_word_t)0x2)
+
+/* Given block ptr bp, is it a guarded block? */
+#define IS_GUARDED(bp)  (GET(HDRP(bp)) & GUARD_BIT)
+
+/* Smallest guarded request size, 0 when the mode is off */
+extern size_t mm_guard_threshold;
+
+/* Read MM_GUARD and MM_GUARD_QUARANTINE from the environment */
+void mm_guard_setup(void);
+
+/* Allocate and free guarded blocks; NULL if the mapping fails */
+void *mm_guard_alloc(size_t size);
+void mm_guard_free(void *bp);
+
+/* Quarantine lock, for holding it across fork */
+void mm_guard_lock(void);
+void mm_guard_unlock(void);
+
+/* Requested payload size of guarded block bp */
+size_t mm_guard_size(void *bp);
+
+#endif /* __MM_GUARD_H__ */
@@ -0,0 +1,158 @@
+/*
+ * mm_preload.c - the allocator as a drop-in malloc for real programs
+ *
+ * Built into a shared library with the thread-safe allocator, this
+ * file defines the C library's malloc family on top of the mm_*
+ * entry points, so that any dynamically linked program runs on it
+ * when started with LD_PRELOAD, along with every child it forks and
+ * execs (the proxy, or tsh and the jobs it starts):
+ *
+ *  gcc -O2 -fPIC -shared -DDRIVER -DMM_THREADS -DMM_WSIZE=8 \
+ *          -DMM_ALIGNMENT=16 -DMM_HEAP_RESERVE='((size_t)1 << 36)' \
+ *          -o mm_preload.so mm_preload.c mm_core.c mm_copy.c mm_region.c \
+ *          -lpthread
+ *  LD_PRELOAD=./mm_preload.so ./proxy 15213
+ *
+ * The heaps live in mmap'ed regions (mm_region.c), not in memlib's
+ * fixed array, and the MM_THREADS build sets up its arenas on the
+ * first call, so nothing has to run before main. MM_HEAP_RESERVE only
+ * reserves address space; pages are committed as the heaps grow.
+ * Memory is never given back to the kernel, so a program's footprint
+ * is its peak heap.
+ *
+ * The C library expects a few things the mdriver never asks for:
+ * 16-byte alignment for any type, a unique pointer for zero bytes,
+ * and errno set to ENOMEM on failure. mm_bench -p runs a few standard
+ * tools with and without the library and compares their output.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "mm.h"
+#include "mm_block.h"
+#include "mm_ext.h"
+
+#ifndef MM_THREADS
+#error "mm_preload.c needs the thread-safe build (-DMM_THREADS)"
+#endif
+
+#if MM_ALIGNMENT < 16
+#error "malloc must align for any type: build with -DMM_ALIGNMENT=16"
+#endif
+
+void *malloc(size_t size)
+{
+    void *p = mm_malloc(size ? size : 1);
+
+    if (p == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+void free(void *ptr)
+{
+    mm_free(ptr);
+}
+
+/* C23 sized frees */
+void free_sized(void *ptr, size_t size)
+{
+    mm_free_sized(ptr, size ? size : 1);
+}
+
+void free_aligned_sized(void *ptr, size_t alignment, size_t size)
+{
+    (void)alignment;
+    mm_free_sized(ptr, size ? size : 1);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    void *p;
+
+    if (nmemb == 0 || size == 0)
+        nmemb = size = 1;
+    if ((p = mm_calloc(nmemb, size)) == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    void *p;
+
+    if (ptr == NULL)
+        return malloc(size);
+    if ((p = mm_realloc(ptr, size)) == NULL && size != 0)
+        errno = ENOMEM;
+    return p;
+}
+
+void *reallocarray(void *ptr, size_t nmemb, size_t size)
+{
+    if (size && nmemb > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return realloc(ptr, nmemb * size);
+}
+
+/*
+ * memalign - the aligned allocators all end up here
+ */
+void *memalign(size_t alignment, size_t size)
+{
+    void *p;
+
+    if (alignment & (alignment - 1)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if ((p = mm_memalign(alignment, size ? size : 1)) == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    int saved = errno;
+    void *p;
+
+    if (alignment % sizeof(void *) || (alignment & (alignment - 1)))
+        return EINVAL;
+    if ((p = memalign(alignment, size)) == NULL) {
+        errno = saved;
+        return ENOMEM;
+    }
+    *memptr = p;
+    return 0;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+void *valloc(size_t size)
+{
+    return memalign(sysconf(_SC_PAGESIZE), size);
+}
+
+void *pvalloc(size_t size)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+
+    if (size > SIZE_MAX - page) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return memalign(page, (size + page - 1) & ~(page - 1));
+}
+
+size_t malloc_usable_size(void *ptr)
+{
+    return mm_usable_size(ptr);
+}
@@ -0,0 +1,229 @@
+/*
+ * mm_region.c - reserved address ranges and NUMA placement
+ *
+ * The range is mapped PROT_NONE with MAP_NORESERVE, which costs only
+ * address space. mm_region_sbrk opens it MM_COMMIT_UNIT at a time, or
+ * one 2 MiB aligned huge page at a time for an MM_REGION_HUGE region.
+ * A bound region gets an mbind(MPOL_PREFERRED) over the whole range
+ * before anything is touched; an unbound region (node < 0) is left to
+ * the kernel's first-touch policy, which places each page on the node
+ * of the thread that writes it first.
+ *
+ * A region can also be reserved at a given address and started from a
+ * file image (mm_region_map_file), which is how mm_core.c brings a
+ * saved heap back at the address it was saved from.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "mm_region.h"
+
+/* granularity in which reserved bytes become read/write (bytes) */
+#ifndef MM_COMMIT_UNIT
+#define MM_COMMIT_UNIT  (1<<16)
+#endif
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000    /* older libc headers */
+#endif
+
+#define ROUNDUP(x, a)   (((size_t)(x) + ((a)-1)) & ~(size_t)((a)-1))
+
+/*
+ * region_setup - bind [start, start + size) to node and fill in r
+ */
+static int region_setup(struct mm_region *r, char *start, size_t size,
+                        size_t unit, int node, int flags)
+{
+    if (node >= 0) {
+        unsigned long mask = 1UL << node;
+
+        /* a failed bind only costs locality, fall back to first touch */
+        if (syscall(SYS_mbind, start, size, MPOL_PREFERRED, &mask,
+                    sizeof(mask) * 8, 0) < 0)
+            node = -1;
+    }
+
+    r->start = start;
+    r->brk = start;
+    r->commit = start;
+    r->end = start + size;
+    r->unit = unit;
+    r->node = node;
+    r->flags = flags;
+    return 0;
+}
+
+/*
+ * mm_region_init - reserve size bytes, bound to node when node >= 0
+ */
+int mm_region_init(struct mm_region *r, size_t size, int node, int flags)
+{
+    size_t unit = (flags & MM_REGION_HUGE) ? MM_HUGE_SIZE : MM_COMMIT_UNIT;
+    size_t slack = (flags & MM_REGION_HUGE) ? MM_HUGE_SIZE : 0;
+    char *p, *start;
+
+    /* over-reserve by one huge page so the start can be aligned */
+    size = ROUNDUP(size, unit);
+    p = mmap(NULL, size + slack, PROT_NONE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED)
+        return -1;
+    start = slack ? (char *)ROUNDUP(p, slack) : p;
+    if (slack) {
+        if (start > p)
+            munmap(p, start - p);
+        if (start + size < p + size + slack)
+            munmap(start + size, p + slack - start);
+    }
+
+    return region_setup(r, start, size, unit, node, flags);
+}
+
+/*
+ * mm_region_init_at - reserve size bytes at start, which must be free
+ */
+int mm_region_init_at(struct mm_region *r, void *start, size_t size,
+                      int node, int flags)
+{
+    size_t unit = (flags & MM_REGION_HUGE) ? MM_HUGE_SIZE : MM_COMMIT_UNIT;
+    char *p;
+
+    if ((flags & MM_REGION_HUGE) && (size_t)start % MM_HUGE_SIZE) {
+        errno = EINVAL;
+        return -1;
+    }
+    size = ROUNDUP(size, unit);
+    p = mmap(start, size, PROT_NONE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED_NOREPLACE,
+             -1, 0);
+    if (p == MAP_FAILED)
+        return -1;
+    /* kernels before 4.17 take the address as a hint only */
+    if (p != start) {
+        munmap(p, size);
+        errno = EEXIST;
+        return -1;
+    }
+
+    return region_setup(r, start, size, unit, node, flags);
+}
+
+/*
+ * mm_region_sbrk - extend the break by incr bytes, opening more of
+ *                  the reservation when the break passes the commit mark
+ */
+void *mm_region_sbrk(struct mm_region *r, size_t incr)
+{
+    char *old_brk = r->brk;
+
+    if (incr > (size_t)(r->end - r->brk)) {
+        errno = ENOMEM;
+        return (void *)-1;
+    }
+
+    if (r->brk + incr > r->commit) {
+        size_t grow = ROUNDUP(r->brk + incr - r->commit, r->unit);
+
+        if (grow > (size_t)(r->end - r->commit))
+            grow = r->end - r->commit;
+        if (mprotect(r->commit, grow, PROT_READ | PROT_WRITE) < 0)
+            return (void *)-1;
+        /* whole aligned 2 MiB chunks, so khugepaged or the fault path
+         * can back each one with a single huge page */
+        if (r->flags & MM_REGION_HUGE)
+            madvise(r->commit, grow, MADV_HUGEPAGE);
+        r->commit += grow;
+    }
+
+    r->brk += incr;
+    return old_brk;
+}
+
+/*
+ * mm_region_map_file - map len bytes of fd from offset off, copy on
+ *                      write, at the break of an empty region
+ */
+void *mm_region_map_file(struct mm_region *r, int fd, off_t off, size_t len)
+{
+    size_t span = ROUNDUP(len, sysconf(_SC_PAGESIZE));
+    size_t commit = ROUNDUP(span, r->unit);
+    char *old_brk = r->brk;
+
+    if (r->brk != r->start || span > (size_t)(r->end - r->start)) {
+        errno = ENOMEM;
+        return (void *)-1;
+    }
+    /* the pages come from the file on first touch, nothing is read now */
+    if (mmap(r->start, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+             fd, off) == MAP_FAILED)
+        return (void *)-1;
+    /* open the rest of the last unit too, so that the commit mark stays
+     * on a unit boundary and mm_region_sbrk goes on in whole chunks */
+    if (commit > (size_t)(r->end - r->start))
+        commit = r->end - r->start;
+    if (commit > span &&
+        mprotect(r->start + span, commit - span, PROT_READ | PROT_WRITE) < 0)
+        return (void *)-1;
+
+    r->brk += len;
+    r->commit += commit;
+    return old_brk;
+}
+
+/*
+ * mm_region_release - unmap the whole reservation
+ */
+void mm_region_release(struct mm_region *r)
+{
+    if (r->start != NULL)
+        munmap(r->start, r->end - r->start);
+    memset(r, 0, sizeof(*r));
+}
+
+/*
+ * mm_numa_nodes - count the nodes listed in sysfs, e.g. "0-1" or "0,2"
+ */
+int mm_numa_nodes(void)
+{
+    char buf[256];
+    int fd, n, last = 0;
+    char *p;
+
+    if ((fd = open("/sys/devices/system/node/possible", 0)) < 0)
+        return 1;
+    n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0)
+        return 1;
+    buf[n] = '\0';
+
+    /* the highest node number is the last number in the list */
+    for (p = buf; *p; p++)
+        if (*p >= '0' && *p <= '9' && (p == buf || p[-1] < '0' || p[-1] > '9'))
+            last = (int)strtol(p, NULL, 10);
+
+    if (last + 1 > MM_MAX_NODES)
+        return MM_MAX_NODES;
+    return last + 1;
+}
+
+/*
+ * mm_getcpu - CPU and node of the calling thread (vDSO, no syscall)
+ */
+void mm_getcpu(unsigned *cpu, unsigned *node)
+{
+    if (getcpu(cpu, node) < 0) {
+        *cpu = 0;
+        *node = 0;
+    }
+}
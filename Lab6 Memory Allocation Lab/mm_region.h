@@ -0,0 +1,59 @@
+/*
+ * mm_region.h - reserved address ranges for allocator heaps
+ *
+ * A region reserves its whole range up front as PROT_NONE and opens
+ * it for reading and writing front to back as the heap grows, so a
+ * heap built on a region stays contiguous just like one built on
+ * mem_sbrk. A region may be tied to a NUMA node, and may be laid out
+ * for transparent huge pages: 2 MiB aligned, opened 2 MiB at a time,
+ * each chunk marked MADV_HUGEPAGE.
+ */
+#ifndef __MM_REGION_H__
+#define __MM_REGION_H__
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Max number of NUMA nodes (real or simulated) the allocator serves */
+#define MM_MAX_NODES    16
+
+/* Transparent huge page size on x86-64 */
+#define MM_HUGE_SIZE    ((size_t)2 << 20)
+
+/* mm_region_init flags */
+#define MM_REGION_HUGE  0x1     /* huge page friendly layout */
+
+struct mm_region {
+    char *start;    /* first byte of the reservation */
+    char *brk;      /* end of the bytes handed out by mm_region_sbrk */
+    char *commit;   /* end of the read/write part */
+    char *end;      /* end of the reservation */
+    size_t unit;    /* how much is opened at a time */
+    int node;       /* node the range is bound to, -1 for first touch */
+    int flags;      /* MM_REGION_* */
+};
+
+/* Reserve size bytes; bind them to node if node >= 0 */
+int mm_region_init(struct mm_region *r, size_t size, int node, int flags);
+
+/* Same, but at address start; fails with EEXIST if start is taken */
+int mm_region_init_at(struct mm_region *r, void *start, size_t size,
+                      int node, int flags);
+
+/* Same contract as mem_sbrk: old break on success, (void *)-1 on failure */
+void *mm_region_sbrk(struct mm_region *r, size_t incr);
+
+/* Start an empty region with len bytes of fd at offset off (page
+ * aligned), mapped copy-on-write; returns like mm_region_sbrk */
+void *mm_region_map_file(struct mm_region *r, int fd, off_t off, size_t len);
+
+/* Give the whole range back to the kernel */
+void mm_region_release(struct mm_region *r);
+
+/* Number of NUMA nodes configured on this machine (at least 1) */
+int mm_numa_nodes(void);
+
+/* CPU and NUMA node the calling thread is running on */
+void mm_getcpu(unsigned *cpu, unsigned *node);
+
+#endif /* __MM_REGION_H__ */
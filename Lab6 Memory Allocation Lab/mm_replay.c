@@ -0,0 +1,191 @@
+/*
+ * mm_replay.c - replay mdriver traces with the heap checked throughout
+ *
+ * Runs each trace through mm_malloc, mm_realloc and mm_free and calls
+ * mm_checkheap(0) after every op (every -k ops for long traces). Each
+ * block is filled with a pattern of its id, and the pattern is checked
+ * when the block is realloc'd or freed, so a class table that hands
+ * out overlapping or short blocks shows up as well as one that breaks
+ * the lists. Build it against mm_core.c like mdriver:
+ *
+ *  gcc -O2 -DDRIVER mm_replay.c mm_core.c mm_copy.c memlib.c
+ *  gcc -O2 -DDRIVER -DMM_CLASSES mm_replay.c mm_core.c mm_copy.c memlib.c
+ *
+ * mm_checkheap reports what it finds on stdout and this driver reports
+ * on stderr, so a clean run prints nothing at all. mm_classcheck.sh
+ * runs it for both builds.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "mm_block.h"
+
+#define MAXLINE         1024
+
+/* one live block of the trace */
+struct block {
+    char *ptr;
+    size_t size;
+};
+
+static struct block *blocks;
+static int num_ids;
+
+/*
+ * fill / check - stamp a block with its id, see that it is still there
+ */
+static void fill(int id, char *p, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+        p[i] = (char)(id * 31 + i);
+}
+
+static int check(int id, const char *p, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+        if (p[i] != (char)(id * 31 + i))
+            return 0;
+    return 1;
+}
+
+/*
+ * replay - run one trace, 0 if every op and every heap check passed
+ */
+static int replay(const char *path, long every)
+{
+    FILE *fp = fopen(path, "r");
+    char line[MAXLINE];
+    int skip = 4;       /* heap size, ids, ops, weight */
+    long ops = 0;
+    struct block *b;
+    unsigned long bytes;
+    int id;
+    char op, *p;
+
+    if (fp == NULL) {
+        perror(path);
+        return -1;
+    }
+    mem_reset_brk();
+    if (mm_init() < 0) {
+        fprintf(stderr, "%s: mm_init failed\n", path);
+        fclose(fp);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (skip > 0) {
+            if (skip-- == 3 && sscanf(line, "%d", &num_ids) == 1 && num_ids > 0)
+                blocks = calloc(num_ids, sizeof(*blocks));
+            continue;
+        }
+        if (blocks == NULL) {
+            fprintf(stderr, "%s: bad header\n", path);
+            goto out;
+        }
+        bytes = 0;
+        if (sscanf(line, " %c %d %lu", &op, &id, &bytes) < 2)
+            continue;
+        if (id < 0 || id >= num_ids) {
+            fprintf(stderr, "%s:%ld: id %d out of range\n", path, ops, id);
+            goto out;
+        }
+        b = &blocks[id];
+
+        switch (op) {
+        case 'a':
+            if ((p = mm_malloc(bytes)) == NULL) {
+                fprintf(stderr, "%s:%ld: mm_malloc(%lu) failed\n", path, ops, bytes);
+                goto out;
+            }
+            b->ptr = p;
+            b->size = bytes;
+            break;
+        case 'r':
+            if ((p = mm_realloc(b->ptr, bytes)) == NULL) {
+                fprintf(stderr, "%s:%ld: mm_realloc(%lu) failed\n", path, ops, bytes);
+                goto out;
+            }
+            if (!check(id, p, bytes < b->size ? bytes : b->size)) {
+                fprintf(stderr, "%s:%ld: block %d lost its contents in realloc\n",
+                        path, ops, id);
+                goto out;
+            }
+            b->ptr = p;
+            b->size = bytes;
+            break;
+        case 'f':
+            if (b->ptr != NULL && !check(id, b->ptr, b->size)) {
+                fprintf(stderr, "%s:%ld: block %d was overwritten\n", path, ops, id);
+                goto out;
+            }
+            mm_free(b->ptr);
+            b->ptr = NULL;
+            b->size = 0;
+            break;
+        default:
+            continue;
+        }
+        if (op != 'f' && (uintptr_t)b->ptr % ALIGNMENT) {
+            fprintf(stderr, "%s:%ld: block %d is misaligned\n", path, ops, id);
+            goto out;
+        }
+        if (op != 'f')
+            fill(id, b->ptr, b->size);
+        if (++ops % every == 0)
+            mm_checkheap(0);
+    }
+    mm_checkheap(0);
+    free(blocks);
+    blocks = NULL;
+    fclose(fp);
+    return 0;
+
+out:
+    free(blocks);
+    blocks = NULL;
+    fclose(fp);
+    return -1;
+}
+
+static void usage(char *prog)
+{
+    fprintf(stderr, "Usage: %s [-h] [-k <ops>] <trace>...\n", prog);
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h            Print this message.\n");
+    fprintf(stderr, "\t-k <ops>      Check the heap every <ops> ops (default 1).\n");
+}
+
+int main(int argc, char **argv)
+{
+    long every = 1;
+    int c, errors = 0;
+
+    while ((c = getopt(argc, argv, "hk:")) != EOF) {
+        switch (c) {
+        case 'k':
+            every = atol(optarg);
+            break;
+        case 'h':
+        default:
+            usage(argv[0]);
+            exit(c != 'h');
+        }
+    }
+    if (every < 1 || optind == argc) {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    mem_init();
+    for (int i = optind; i < argc; i++)
+        if (replay(argv[i], every) < 0)
+            errors++;
+    fflush(stdout);
+    return errors ? 1 : 0;
+}
@@ -59,49 +59,25 @@
 #endif /* def DRIVER */
 
 
+/* Block format: 4-byte header/footer words, 8-byte alignment */
+#define MM_WSIZE        4
+#define MM_ALIGNMENT    8
+#include "mm_block.h"
+
 /* Basic constants and macros */
-#define WSIZE       4       /* word size (bytes) */
-#define DSIZE       8       /* doubleword size (bytes) */
 #define CHUNKSIZE  (1<<12)  /* initial heap size (bytes) */
 #define OVERHEAD    16      /* overhead of header and footer (bytes) */
 
 #define MAX(x, y) ((x) > (y)? (x) : (y))
 
-/* Pack a size and allocated bit into a word */
-#define PACK(size, alloc)  ((size) | (alloc))
-
-/* Read and write a word at address p */
-#define GET(p)       (*(unsigned int *)(p))
-#define PUT(p, val)  (*(unsigned int *)(p) = (val))
-
 #define PUT_ADDR(p, val)    (*(int *)(p) = (int)(long)(val))
 
-/* Read the size and allocated fields from address p */
-#define GET_SIZE(p)  (GET(p) & ~0x7)
-#define GET_ALLOC(p) (GET(p) & 0x1)
-
-/* Given block ptr bp, compute address of its header and footer */
-#define HDRP(bp)       ((char *)(bp) - WSIZE)
-#define FTRP(bp)       ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
-
 /* Given block ptr bp, read address of its next/prev free block pointer */
 #define NEXTP(bp)      ((int *)((char *)(bp)))
 #define PREVP(bp)      ((int *)((char *)(bp) + WSIZE))
 
-/* Given block ptr bp, compute address of next and previous blocks */
-#define NEXT_BLKP(bp)  ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
-#define PREV_BLKP(bp)  ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
-
-/* single word (4) or double word (8) alignment */
-#define ALIGNMENT 8
-
-/* rounds up to the nearest multiple of ALIGNMENT */
-#define ALIGN(p) (((size_t)(p) + (ALIGNMENT-1)) & ~0x7)
-
 #define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
 
-#define MIN_BLKSIZE 16
-
 /* class no: 0 - NUM_FREELIST-1 */
 #define NUM_FREELIST 10
 
@@ -109,24 +85,24 @@
 char *heap_listp;
 
 /* function prototypes for internal helper routines */
-inline void *extend_heap(size_t words);
-inline void place(void *bp, size_t asize);
-inline void *find_fit(size_t asize);
-inline void *coalesce(void *bp);
-inline void printblock(void *bp);
-inline void checkblock(void *bp);
-inline void delete_freenode(void *bp);
-inline void insert_freenode(void *bp);
-inline void printfreelist();
-inline void *getroot(int class);
-inline int getclass(size_t size);
-inline void check_heapboundaries(void *heapstart, void *heapend);
-inline void checkfreelist(int freeblockcount);
-inline int aligned(const void *p);
-inline int in_heap(const void *p);
-inline void *offset2addr(int offset);
-inline void *next_free_blck(void *bp);
-inline void *prev_free_blck(void *bp);
+static inline void *extend_heap(size_t words);
+static inline void place(void *bp, size_t asize);
+static inline void *find_fit(size_t asize);
+static inline void *coalesce(void *bp);
+static inline void printblock(void *bp);
+static inline void checkblock(void *bp);
+static inline void delete_freenode(void *bp);
+static inline void insert_freenode(void *bp);
+static inline void printfreelist();
+static inline void *getroot(int class);
+static inline int getclass(size_t size);
+static inline void check_heapboundaries(void *heapstart, void *heapend);
+static inline void checkfreelist(int freeblockcount);
+static inline int aligned(const void *p);
+static inline int in_heap(const void *p);
+static inline void *offset2addr(int offset);
+static inline void *next_free_blck(void *bp);
+static inline void *prev_free_blck(void *bp);
 
 /*
  * mm_init - Initialize the memory manager
@@ -202,7 +178,7 @@ void free(void *bp)
 /*
  * delete_freenode - delete the block from free list when it is allocated
  */
-inline void delete_freenode(void *bp)
+static inline void delete_freenode(void *bp)
 {
     void *next_free_block_addr = next_free_blck(bp);
     void *prev_free_block_addr = (void *)prev_free_blck(bp);
@@ -215,7 +191,7 @@ inline void delete_freenode(void *bp)
 /*
  * insert_freenode - insert the freed block to the free list
  */
-inline void insert_freenode(void *bp)
+static inline void insert_freenode(void *bp)
 {
     size_t size = GET_SIZE(HDRP(bp));
     void *root = getroot(getclass(size));
@@ -372,7 +348,7 @@ void mm_checkheap(int verbose)
 /*
  * getclass - Get class for given size
  */
-inline int getclass(size_t size)
+static inline int getclass(size_t size)
 {
     int block = size / DSIZE;
 
@@ -410,7 +386,7 @@ inline int getclass(size_t size)
 /*
  * getroot - Get root node for corresponding class
  */
-inline void *getroot(int class)
+static inline void *getroot(int class)
 {
     return heap_listp + class * 2 * DSIZE;
 }
@@ -418,7 +394,7 @@ inline void *getroot(int class)
 /*
  * extend_heap - Extend heap with free block and return its block pointer
  */
-inline void *extend_heap(size_t words)
+static inline void *extend_heap(size_t words)
 {
     void *bp;
     size_t size;
@@ -442,7 +418,7 @@ inline void *extend_heap(size_t words)
  * place - Place block of asize bytes at start of free block bp
  *         and split if remainder would be at least minimum block size
  */
-inline void place(void *bp, size_t asize)
+static inline void place(void *bp, size_t asize)
 {
     size_t csize = GET_SIZE(HDRP(bp));
     int is_realloc = GET_ALLOC(HDRP(bp));
@@ -479,7 +455,7 @@ inline void place(void *bp, size_t asize)
 /*
  * find_fit - Find a fit for a block with asize bytes
  */
-inline void *find_fit(size_t asize)
+static inline void *find_fit(size_t asize)
 {
     dbg_printf("FINDING FIT: ");
     void *bp;
@@ -503,7 +479,7 @@ inline void *find_fit(size_t asize)
 /*
  * coalesce - boundary tag coalescing. Return ptr to coalesced block
  */
-inline void *coalesce(void *bp)
+static inline void *coalesce(void *bp)
 {
     size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
     size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
@@ -548,7 +524,7 @@ inline void *coalesce(void *bp)
 /*
  * printblock - print the header, footer and pointers of each block
  */
-inline void printblock(void *bp)
+static inline void printblock(void *bp)
 {
     size_t hsize, halloc, fsize, falloc;
     long next, prev;
@@ -579,7 +555,7 @@ inline void printblock(void *bp)
 /*
  * printfreelist - print each free list
  */
-inline void printfreelist()
+static inline void printfreelist()
 {
     
     for (int i = 0; i < NUM_FREELIST; i++) {
@@ -597,7 +573,7 @@ inline void printfreelist()
  * checkblock - check alignment, minmium size requirement,
                 and consistency of header and footer
  */
-inline void checkblock(void *bp)
+static inline void checkblock(void *bp)
 {
     if (!aligned(bp))
         printf("Error: %p is not aligned\n", bp);
@@ -611,7 +587,7 @@ inline void checkblock(void *bp)
 /*
  * check_heapboundaries - check if heap boundaries matches head and end blocks
  */
-inline void check_heapboundaries(void *heapstart, void *heapend)
+static inline void check_heapboundaries(void *heapstart, void *heapend)
 {
     if (heapstart != mem_heap_lo()) {
         printf("Error: heap start point %p is not equaled to heap low boundary %p\n",
@@ -626,7 +602,7 @@ inline void check_heapboundaries(void *heapstart, void *heapend)
 /*
  * checkfreelist - check the free list
  */
-inline void checkfreelist(int freeblockcount)
+static inline void checkfreelist(int freeblockcount)
 {
     int free_count = 0;
     for (int i = 0; i < NUM_FREELIST; i++) {
@@ -665,7 +641,7 @@ inline void checkfreelist(int freeblockcount)
  * Return whether the pointer is in the heap.
  * May be useful for debugging.
  */
-inline int in_heap(const void *p) {
+static inline int in_heap(const void *p) {
     if (p == NULL) {
         return 1;
     }
@@ -676,14 +652,14 @@ inline int in_heap(const void *p) {
  * Return whether the pointer is aligned.
  * May be useful for debugging.
  */
-inline int aligned(const void *p) {
+static inline int aligned(const void *p) {
     return (size_t)ALIGN(p) == (size_t)p;
 }
 
 /*
  * offset2addr - restore the offset to address
  */
-inline void *offset2addr(int offset)
+static inline void *offset2addr(int offset)
 {
     if (offset) {
         return (void *)((long)offset | 0x800000000);
@@ -695,7 +671,7 @@ inline void *offset2addr(int offset)
 /*
  * next_free_blck - Given block bp, get next free block
  */
-inline void *next_free_blck(void *bp)
+static inline void *next_free_blck(void *bp)
 {
     int offset = *NEXTP(bp);
     return offset2addr(offset);
@@ -704,7 +680,7 @@ inline void *next_free_blck(void *bp)
 /*
  * prev_free_blck - Given block bp, get previous block
  */
-inline void *prev_free_blck(void *bp)
+static inline void *prev_free_blck(void *bp)
 {
     int offset = *PREVP(bp);
     return offset2addr(offset);
@@ -47,35 +47,16 @@
 #define checkheap mm_checkheap
 #endif /* def DRIVER */
 
+/* Block format: 4-byte header/footer words, 8-byte alignment */
+#define MM_WSIZE    4
+#define MM_ALIGNMENT 8
+#include "mm_block.h"
+
 /* Basic constants and macros */
-#define WSIZE       4       /* Word and header/footer size (bytes) */ 
-#define DSIZE       8       /* Double word size (bytes) */
 #define CHUNKSIZE  (1<<8)  /* Extend heap by this amount (bytes) */  
-#define ALIGNMENT 8         /* single word (4) or double word (8) alignment */
 #define MINIMUM   24
 
 #define MAX(x, y) ((x) > (y)? (x) : (y))
-/* rounds up to the nearest multiple of ALIGNMENT */
-#define ALIGN(p) (((size_t)(p) + (ALIGNMENT-1)) & ~0x7)
-
-/* Pack a size and allocated bit into a word */
-#define PACK(size, alloc)  ((size) | (alloc))
-
-/* Read and write a word at address p */
-#define GET(p)       (*(unsigned int *)(p))
-#define PUT(p, val)  (*(unsigned int *)(p) = (val))
-
-/* Read the size and allocated fields from address p */
-#define GET_SIZE(p)  (GET(p) & ~0x7)
-#define GET_ALLOC(p) (GET(p) & 0x1)
-
-/* Given block ptr ptr, compute address of its header and footer */
-#define HDRP(ptr)       ((char *)(ptr) - WSIZE)
-#define FTRP(ptr)       ((char *)(ptr) + GET_SIZE(HDRP(ptr)) - DSIZE)
-
-/* Given block ptr ptr, compute address of next and previous blocks */
-#define NEXT_BLKP(ptr)  ((char *)(ptr) + GET_SIZE(HDRP(ptr)))
-#define PREV_BLKP(ptr)  ((char *)(ptr) - GET_SIZE(HDRP(ptr) - WSIZE))
 
 /* Given free list ptr, compute address of next and previous free list ptrs */
 #define NEXT_FREEP(ptr)  (*(char **)((char *)(ptr) + DSIZE))
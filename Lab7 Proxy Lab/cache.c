@@ -0,0 +1,623 @@
+#define _GNU_SOURCE // memfd_create
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include "cache.h"
+
+#define INIT_BUCKETS 32 // per shard
+
+/* top bits pick the shard, low bits the bucket inside it */
+#define SHARD_OF(p_Cache, hash) (&(p_Cache)->shard[(hash) >> (32 - CACHE_SHARD_BITS)])
+
+static unsigned hash_url(const char* url);
+static Cache_obj* lookup(Cache_shard* s, const char* url, unsigned hash);
+static void ring_unlink(Cache_shard* s, Cache_obj* p);
+static void ring_insert(Cache_shard* s, Cache_obj* p);
+static Cache_obj* clock_victim(Cache_shard* s);
+static void evict(Cache_shard* s, Cache_obj* p);
+static int reserve(Cache_shard* s, Cache_obj* p);
+static void unreserve(Cache_shard* s, Cache_obj* p);
+static void grow(Cache_shard* s);
+static long fill_base(Cache_fill* f);
+static void fill_room(Cache_fill* f);
+static void fill_unlink(Cache_fill* f);
+static void fill_put(Cache_fill* f);
+
+Cache* Cache_init(void)
+{
+	Cache* p_Cache = NULL;
+	int i;
+
+	/* shards are cache line aligned so that their locks do not share lines */
+	if((errno = posix_memalign((void**)&p_Cache, 64, sizeof(struct Cache))) != 0)
+		unix_error("Cache_init error");
+	if((p_Cache->store_fd = memfd_create("proxy-cache", 0)) < 0 ||
+	   ftruncate(p_Cache->store_fd, (off_t)CACHE_SHARDS * SHARD_SIZE) < 0)
+		unix_error("Cache_init error");
+	p_Cache->store = Mmap(NULL, (size_t)CACHE_SHARDS * SHARD_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, p_Cache->store_fd, 0);
+	for(i = 0; i < CACHE_SHARDS; i++)
+	{
+		Cache_shard* s = &p_Cache->shard[i];
+
+		pthread_rwlock_init(&s->lock, NULL);
+		s->n_bucket = INIT_BUCKETS;
+		s->bucket = Calloc(INIT_BUCKETS, sizeof(Cache_obj*));
+		s->n_obj = 0;
+		s->ring.c_next = s->ring.c_prev = &s->ring;
+		s->hand = &s->ring;
+		s->base = p_Cache->store + (size_t)i * SHARD_SIZE;
+		s->extent = NULL;
+		s->flight = NULL;
+	}
+	return p_Cache;
+}
+
+/*
+ * Search_and_Transfer - look url up; on a hit send the object to fd.
+ * *p_hit is the object or NULL; the caller Cache_release()s a hit.
+ * -1 if fd failed.
+ */
+int Search_and_Transfer(char* url, Cache* p_Cache, int fd, void** p_hit)
+{
+	Cache_obj* p;
+	ssize_t n;
+	int off, rc = 0;
+
+	if((p = Cache_lookup(p_Cache, url)) != NULL)
+	{
+		for(off = 0; off < p->obj_size; off += n)
+			if((n = Cache_send(p_Cache, p, fd, off)) <= 0)
+			{
+				if(n < 0 && errno == EINTR)
+				{
+					n = 0;
+					continue;
+				}
+				fprintf(stderr, "Search_and_Transfer error: %s\n", strerror(errno));
+				rc = -1;
+				break;
+			}
+	}
+	*p_hit = p;
+	return rc;
+}
+
+/*
+ * Cache_lookup - look url up and mark it referenced. The object stays
+ * valid, even if it is evicted meanwhile, until Cache_release, so the
+ * caller may send it without holding the shard lock.
+ */
+Cache_obj* Cache_lookup(Cache* p_Cache, char* url)
+{
+	unsigned hash = hash_url(url);
+	Cache_shard* s = SHARD_OF(p_Cache, hash);
+	Cache_obj* p;
+
+	pthread_rwlock_rdlock(&s->lock);
+	if((p = lookup(s, url, hash)) != NULL)
+	{
+		/* test first: a hot object's line is not written on every hit */
+		if(!__atomic_load_n(&p->ref, __ATOMIC_RELAXED))
+			__atomic_store_n(&p->ref, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&p->refs, 1, __ATOMIC_RELAXED);
+	}
+	pthread_rwlock_unlock(&s->lock);
+	return p;
+}
+
+/* Cache_send - one sendfile() of what is left of p past off, to fd */
+ssize_t Cache_send(Cache* p_Cache, Cache_obj* p, int fd, int off)
+{
+	off_t pos = (p->response_body - p_Cache->store) + off;
+
+	return sendfile(fd, p_Cache->store_fd, &pos, p->obj_size - off);
+}
+
+/*
+ * Cache_release - drop a reference. The last one, always after the
+ * object was evicted, gives its bytes back to the shard.
+ */
+void Cache_release(Cache_obj* p)
+{
+	Cache_shard* s = p->shard;
+
+	if(__atomic_sub_fetch(&p->refs, 1, __ATOMIC_ACQ_REL) == 0)
+	{
+		pthread_rwlock_wrlock(&s->lock);
+		unreserve(s, p);
+		pthread_rwlock_unlock(&s->lock);
+	}
+}
+
+/*
+ * Write_and_Update - cache size bytes of buf under url, evicting from its
+ * shard by CLOCK until a hole fits them. The room is reserved under the
+ * write lock and filled outside it; readers only wait for the link.
+ */
+void Write_and_Update(Cache* p_Cache, int size, char* url, char* buf)
+{
+	unsigned hash = hash_url(url);
+	Cache_shard* s = SHARD_OF(p_Cache, hash);
+	Cache_obj* p;
+
+	if(size > MAX_OBJECT_SIZE)
+		return;
+
+	p = Malloc(sizeof(struct Cache_obj));
+	p->p_url = Malloc(strlen(url) + 1);
+	strcpy(p->p_url, url);
+	p->obj_size = size;
+	p->hash = hash;
+	p->shard = s;
+	p->refs = 1;
+
+	pthread_rwlock_wrlock(&s->lock);
+	if(lookup(s, url, hash) != NULL) // another thread cached it first
+	{
+		pthread_rwlock_unlock(&s->lock);
+		Free(p->p_url);
+		Free(p);
+		return;
+	}
+	while(reserve(s, p) < 0)
+	{
+		if(s->ring.c_next == &s->ring) // the rest is held by hits still being sent
+		{
+			pthread_rwlock_unlock(&s->lock);
+			Free(p->p_url);
+			Free(p);
+			return;
+		}
+		evict(s, clock_victim(s));
+	}
+	pthread_rwlock_unlock(&s->lock);
+
+	memcpy(p->response_body, buf, size);
+
+	pthread_rwlock_wrlock(&s->lock);
+	if(lookup(s, url, hash) != NULL) // cached by another thread while copying
+	{
+		unreserve(s, p);
+		pthread_rwlock_unlock(&s->lock);
+		return;
+	}
+	p->h_next = s->bucket[hash & (s->n_bucket - 1)];
+	s->bucket[hash & (s->n_bucket - 1)] = p;
+	ring_insert(s, p);
+	if(++s->n_obj > s->n_bucket)
+		grow(s);
+	pthread_rwlock_unlock(&s->lock);
+}
+
+/*
+ * Fill_join - *p_leader = 1 and a new fill if nobody is fetching url yet,
+ * else subscribe sub to the fill in flight. NULL if url is in the cache
+ * by now: look it up again.
+ */
+Cache_fill* Fill_join(Cache* p_Cache, char* url, Fill_sub* sub, int* p_leader)
+{
+	unsigned hash = hash_url(url);
+	Cache_shard* s = SHARD_OF(p_Cache, hash);
+	Cache_fill* f;
+
+	pthread_rwlock_wrlock(&s->lock);
+	if(lookup(s, url, hash) != NULL)
+	{
+		pthread_rwlock_unlock(&s->lock);
+		return NULL;
+	}
+	for(f = s->flight; f != NULL; f = f->f_next)
+		if(f->hash == hash && !strcmp(f->p_url, url))
+			break;
+	if(f != NULL)
+	{
+		pthread_mutex_lock(&f->lock);
+		sub->off = 0;
+		sub->waiting = 0;
+		sub->next = f->subs;
+		f->subs = sub;
+		f->n_subs++;
+		f->refs++;
+		pthread_mutex_unlock(&f->lock);
+		*p_leader = 0;
+	}
+	else
+	{
+		f = Malloc(sizeof(struct Cache_fill));
+		f->p_url = Malloc(strlen(url) + 1);
+		strcpy(f->p_url, url);
+		f->hash = hash;
+		f->shard = s;
+		f->f_next = s->flight;
+		s->flight = f;
+		f->linked = 1;
+		pthread_mutex_init(&f->lock, NULL);
+		pthread_cond_init(&f->more, NULL);
+		pthread_cond_init(&f->room, NULL);
+		f->buf = NULL;
+		f->cap = 0;
+		f->size = 0;
+		f->cacheable = 1;
+		f->state = FILL_RUNNING;
+		f->subs = f->leader = NULL;
+		f->n_subs = 0;
+		f->refs = 1;
+		*p_leader = 1;
+	}
+	pthread_rwlock_unlock(&s->lock);
+	return f;
+}
+
+/*
+ * Fill_space - how much the leader may read and append now. Unbounded
+ * without subscribers; with them, buf must keep every byte one of them
+ * still has to read. While f may be joined, a newcomer starts at byte 0,
+ * so the leader stops at MAX_OBJECT_SIZE, and closes f before reading on.
+ * If there is no room, 0 once leader->wake is due, or wait for room if
+ * leader has none.
+ */
+long Fill_space(Cache_fill* f, Fill_sub* leader)
+{
+	long space;
+
+	if(f->linked && f->size == MAX_OBJECT_SIZE) // only the leader unlinks, no lock needed to look
+		fill_unlink(f);
+	pthread_mutex_lock(&f->lock);
+	while(1)
+	{
+		if(f->n_subs == 0)
+			space = LONG_MAX;
+		else if(f->cacheable) // nothing is dropped until the response outgrows the cache
+			space = MAX_OBJECT_SIZE - f->size + fill_base(f);
+		else
+			space = MAX_OBJECT_SIZE - (f->size - fill_base(f));
+		if(f->linked && space > MAX_OBJECT_SIZE - f->size)
+			space = MAX_OBJECT_SIZE - f->size;
+		if(space > 0 || leader->wake != NULL)
+			break;
+		pthread_cond_wait(&f->room, &f->lock);
+	}
+	if(space == 0)
+		f->leader = leader;
+	pthread_mutex_unlock(&f->lock);
+	return space;
+}
+
+/*
+ * Fill_append - tee n bytes of the response into f, n no more than
+ * Fill_space allowed. -1 once the response outgrew MAX_OBJECT_SIZE and
+ * no subscriber is left: the leader goes on alone.
+ */
+int Fill_append(Cache_fill* f, char* buf, int n)
+{
+	Fill_sub* sub;
+	int i, part;
+
+	pthread_mutex_lock(&f->lock);
+	if(f->size + n > MAX_OBJECT_SIZE)
+		f->cacheable = 0;
+	if(!f->cacheable && f->n_subs == 0)
+	{
+		pthread_mutex_unlock(&f->lock);
+		return -1;
+	}
+	if(f->cap < MAX_OBJECT_SIZE && f->size + n > f->cap) // doubles, a small response never holds MAX_OBJECT_SIZE
+	{
+		f->cap = f->cap ? f->cap * 2 : 4096;
+		if(f->cap < f->size + n || f->cap > MAX_OBJECT_SIZE)
+			f->cap = MAX_OBJECT_SIZE;
+		f->buf = Realloc(f->buf, f->cap);
+	}
+	for(i = 0; i < n; i += part) // may wrap once the response outgrew the cache
+	{
+		part = MAX_OBJECT_SIZE - (int)((f->size + i) % MAX_OBJECT_SIZE);
+		if(part > n - i)
+			part = n - i;
+		memcpy(f->buf + (f->size + i) % MAX_OBJECT_SIZE, buf + i, part);
+	}
+	f->size += n;
+	for(sub = f->subs; sub != NULL; sub = sub->next)
+		if(sub->waiting)
+		{
+			sub->waiting = 0;
+			sub->wake(sub);
+		}
+	pthread_cond_broadcast(&f->more);
+	pthread_mutex_unlock(&f->lock);
+	return 0;
+}
+
+int Fill_shared(Cache_fill* f)
+{
+	int n;
+
+	pthread_mutex_lock(&f->lock);
+	n = f->n_subs;
+	pthread_mutex_unlock(&f->lock);
+	return n > 0;
+}
+
+/*
+ * Fill_end - the leader is done with f. If ok the whole response is in:
+ * it is cached when small enough, before f stops being joinable, so a
+ * later miss finds one or the other.
+ */
+void Fill_end(Cache* p_Cache, Cache_fill* f, int ok)
+{
+	Fill_sub* sub;
+
+	if(ok && f->cacheable && f->size > 0) // only the leader writes buf, no lock needed to read it
+		Write_and_Update(p_Cache, f->size, f->p_url, f->buf);
+	fill_unlink(f);
+	pthread_mutex_lock(&f->lock);
+	f->state = ok ? FILL_DONE : FILL_FAILED;
+	f->leader = NULL;
+	for(sub = f->subs; sub != NULL; sub = sub->next)
+		if(sub->waiting)
+		{
+			sub->waiting = 0;
+			sub->wake(sub);
+		}
+	pthread_cond_broadcast(&f->more);
+	fill_put(f);
+}
+
+/*
+ * Fill_read - copy up to n bytes from sub's place in the response. If
+ * there are none yet, FILL_WAIT once sub->wake is due, or wait for them
+ * if sub has none.
+ */
+int Fill_read(Cache_fill* f, Fill_sub* sub, char* buf, int n)
+{
+	long avail;
+	int part;
+
+	pthread_mutex_lock(&f->lock);
+	while((avail = f->size - sub->off) == 0)
+	{
+		if(f->state != FILL_RUNNING)
+		{
+			n = f->state == FILL_DONE ? 0 : -1;
+			pthread_mutex_unlock(&f->lock);
+			return n;
+		}
+		if(sub->wake != NULL)
+		{
+			sub->waiting = 1;
+			pthread_mutex_unlock(&f->lock);
+			return FILL_WAIT;
+		}
+		pthread_cond_wait(&f->more, &f->lock);
+	}
+	if(n > avail)
+		n = avail;
+	part = MAX_OBJECT_SIZE - (int)(sub->off % MAX_OBJECT_SIZE); // to the end of the ring
+	if(n > part)
+		n = part;
+	memcpy(buf, f->buf + sub->off % MAX_OBJECT_SIZE, n);
+	sub->off += n;
+	fill_room(f);
+	pthread_mutex_unlock(&f->lock);
+	return n;
+}
+
+void Fill_leave(Cache_fill* f, Fill_sub* sub)
+{
+	Fill_sub** pp;
+
+	pthread_mutex_lock(&f->lock);
+	for(pp = &f->subs; *pp != sub; pp = &(*pp)->next)
+		;
+	*pp = sub->next;
+	f->n_subs--;
+	fill_room(f);
+	fill_put(f);
+}
+
+void Destroy_Cache(Cache* p_Cache)
+{
+	int i;
+
+	for(i = 0; i < CACHE_SHARDS; i++)
+	{
+		Cache_shard* s = &p_Cache->shard[i];
+
+		pthread_rwlock_wrlock(&s->lock);
+		while(s->ring.c_next != &s->ring)
+			evict(s, s->ring.c_next);
+		Free(s->bucket);
+		pthread_rwlock_unlock(&s->lock);
+		pthread_rwlock_destroy(&s->lock);
+	}
+	Munmap(p_Cache->store, (size_t)CACHE_SHARDS * SHARD_SIZE);
+	Close(p_Cache->store_fd);
+	Free(p_Cache);
+}
+
+/* FNV-1a */
+static unsigned hash_url(const char* url)
+{
+	unsigned h = 2166136261u;
+	while(*url)
+		h = (h ^ (unsigned char)*url++) * 16777619u;
+	return h;
+}
+
+static Cache_obj* lookup(Cache_shard* s, const char* url, unsigned hash)
+{
+	Cache_obj* p = s->bucket[hash & (s->n_bucket - 1)];
+	for(; p != NULL; p = p->h_next)
+		if(p->hash == hash && !strcmp(p->p_url, url))
+			return p;
+	return NULL;
+}
+
+static void ring_unlink(Cache_shard* s, Cache_obj* p)
+{
+	if(s->hand == p)
+		s->hand = p->c_next;
+	p->c_prev->c_next = p->c_next;
+	p->c_next->c_prev = p->c_prev;
+}
+
+/* ring_insert - put p just behind the hand, the sweep reaches it last */
+static void ring_insert(Cache_shard* s, Cache_obj* p)
+{
+	p->ref = 0;
+	p->c_next = s->hand;
+	p->c_prev = s->hand->c_prev;
+	s->hand->c_prev->c_next = p;
+	s->hand->c_prev = p;
+}
+
+/*
+ * clock_victim - advance the hand, clearing reference bits, to the first
+ * object not referenced since the last sweep; write lock held, so no hit
+ * sets a bit meanwhile and two turns of the ring are enough
+ */
+static Cache_obj* clock_victim(Cache_shard* s)
+{
+	Cache_obj* p;
+
+	for(;;)
+	{
+		p = s->hand;
+		s->hand = p->c_next;
+		if(p == &s->ring)
+			continue;
+		if(!__atomic_load_n(&p->ref, __ATOMIC_RELAXED))
+			return p;
+		__atomic_store_n(&p->ref, 0, __ATOMIC_RELAXED);
+	}
+}
+
+/* evict - drop p from its bucket and the ring and release it; write lock held */
+static void evict(Cache_shard* s, Cache_obj* p)
+{
+	Cache_obj** pp = &s->bucket[p->hash & (s->n_bucket - 1)];
+	while(*pp != p)
+		pp = &(*pp)->h_next;
+	*pp = p->h_next;
+	ring_unlink(s, p);
+	s->n_obj--;
+	if(__atomic_sub_fetch(&p->refs, 1, __ATOMIC_ACQ_REL) == 0) // else the last Cache_release does it
+		unreserve(s, p);
+}
+
+/*
+ * reserve - give p the first hole of the shard that fits it, -1 if there
+ * is none; write lock held
+ */
+static int reserve(Cache_shard* s, Cache_obj* p)
+{
+	Cache_obj* prev = NULL;
+	Cache_obj* q;
+	char* start = s->base; // of the hole before q
+
+	for(q = s->extent; q != NULL; prev = q, q = q->a_next)
+	{
+		if(q->response_body - start >= p->obj_size)
+			break;
+		start = q->response_body + q->obj_size;
+	}
+	if(q == NULL && s->base + SHARD_SIZE - start < p->obj_size)
+		return -1;
+	p->response_body = start;
+	p->a_prev = prev;
+	p->a_next = q;
+	if(prev != NULL)
+		prev->a_next = p;
+	else
+		s->extent = p;
+	if(q != NULL)
+		q->a_prev = p;
+	return 0;
+}
+
+/* unreserve - give p's bytes back to the shard and free it; write lock held */
+static void unreserve(Cache_shard* s, Cache_obj* p)
+{
+	if(p->a_prev != NULL)
+		p->a_prev->a_next = p->a_next;
+	else
+		s->extent = p->a_next;
+	if(p->a_next != NULL)
+		p->a_next->a_prev = p->a_prev;
+	Free(p->p_url);
+	Free(p);
+}
+
+/* grow - double the buckets once there are more objects than buckets; write lock held */
+static void grow(Cache_shard* s)
+{
+	unsigned n = s->n_bucket * 2;
+	Cache_obj** bucket = Calloc(n, sizeof(Cache_obj*));
+	Cache_obj* p;
+
+	for(p = s->ring.c_next; p != &s->ring; p = p->c_next)
+	{
+		p->h_next = bucket[p->hash & (n - 1)];
+		bucket[p->hash & (n - 1)] = p;
+	}
+	Free(s->bucket);
+	s->bucket = bucket;
+	s->n_bucket = n;
+}
+
+/* fill_base - first byte a subscriber still has to read; f locked, with subscribers */
+static long fill_base(Cache_fill* f)
+{
+	Fill_sub* sub;
+	long base = f->size;
+
+	for(sub = f->subs; sub != NULL; sub = sub->next)
+		if(sub->off < base)
+			base = sub->off;
+	return base;
+}
+
+/* fill_room - a subscriber moved on or left: let a leader waiting for room go on; f locked */
+static void fill_room(Cache_fill* f)
+{
+	if(f->leader != NULL)
+	{
+		f->leader->wake(f->leader);
+		f->leader = NULL;
+	}
+	pthread_cond_broadcast(&f->room);
+}
+
+/* fill_unlink - take f off its shard's flight list, no one joins it from now on */
+static void fill_unlink(Cache_fill* f)
+{
+	Cache_shard* s = f->shard;
+	Cache_fill** pp;
+
+	pthread_rwlock_wrlock(&s->lock);
+	if(f->linked)
+	{
+		for(pp = &s->flight; *pp != f; pp = &(*pp)->f_next)
+			;
+		*pp = f->f_next;
+		f->linked = 0;
+	}
+	pthread_rwlock_unlock(&s->lock);
+}
+
+/* fill_put - drop a reference and unlock f; the last one frees it */
+static void fill_put(Cache_fill* f)
+{
+	int last = --f->refs == 0;
+
+	pthread_mutex_unlock(&f->lock);
+	if(last)
+	{
+		pthread_mutex_destroy(&f->lock);
+		pthread_cond_destroy(&f->more);
+		pthread_cond_destroy(&f->room);
+		Free(f->p_url);
+		if(f->buf != NULL)
+			Free(f->buf);
+		Free(f);
+	}
+}
@@ -0,0 +1,132 @@
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include "csapp.h"
+
+#define MAX_CACHE_SIZE 1049000
+#define MAX_OBJECT_SIZE 102400
+
+/* 2^CACHE_SHARD_BITS shards, each holding MAX_CACHE_SIZE / shards bytes of the store */
+#ifndef CACHE_SHARD_BITS
+#define CACHE_SHARD_BITS 3
+#endif
+#define CACHE_SHARDS (1 << CACHE_SHARD_BITS)
+#define SHARD_SIZE (MAX_CACHE_SIZE / CACHE_SHARDS)
+
+#if SHARD_SIZE < MAX_OBJECT_SIZE
+#error "every shard must have room for a MAX_OBJECT_SIZE object"
+#endif
+
+/* one cached response, keyed by the "host:port/uri" string doit() builds */
+typedef struct Cache_obj{
+	char* p_url;
+	char* response_body; // in the store, obj_size bytes
+	int obj_size;
+	unsigned hash;
+	struct Cache_obj* h_next; // next object in the same hash bucket
+	struct Cache_obj* c_prev; // CLOCK ring of the shard
+	struct Cache_obj* c_next;
+	struct Cache_obj* a_prev; // objects of the shard in store order, the holes are between them
+	struct Cache_obj* a_next;
+	struct Cache_shard* shard;
+	int ref; // set by hits, cleared as the hand sweeps past
+	int refs; // one for the cache while linked, one per Cache_lookup not yet released
+}Cache_obj;
+
+/*
+ * a shard: a chained hash table for lookup and a CLOCK ring through the
+ * same objects for eviction, under a lock of its own. A hit only sets the
+ * object's reference bit, so lookups never need more than the read lock;
+ * the hand sweeps when an insert needs room, under the write lock, and
+ * evicts the first object not referenced since it last came by. An
+ * object's bytes stay in the shard's part of the store until its last
+ * reference is gone, so the hand sweeps until a large enough hole opens.
+ */
+typedef struct Cache_shard{
+	pthread_rwlock_t lock; // readers look up, writers insert and evict
+	Cache_obj** bucket;
+	unsigned n_bucket; // power of two
+	unsigned n_obj;
+	Cache_obj ring; // ring head, never evicted
+	Cache_obj* hand; // next object the sweep looks at
+	char* base; // SHARD_SIZE bytes of the store
+	Cache_obj* extent; // lowest object in the store, NULL if none
+	struct Cache_fill* flight; // misses being fetched that others may still join
+}__attribute__((aligned(64))) Cache_shard;
+
+/*
+ * the cache: urls are spread over the shards by the top bits of their
+ * hash. The objects live in a memfd mapped once, so a hit is sent with
+ * sendfile() straight from the page cache and never crosses user space.
+ */
+typedef struct Cache{
+	int store_fd;
+	char* store; // store_fd mapped, CACHE_SHARDS * SHARD_SIZE bytes
+	Cache_shard shard[CACHE_SHARDS];
+}Cache;
+
+/* Fill_read: nothing yet, the subscriber's wake will be called */
+#define FILL_WAIT -2
+
+/* a client following a Cache_fill that another client started */
+typedef struct Fill_sub{
+	long off; // next byte of the response to read
+	int waiting; // wake is due once there is more
+	void (*wake)(struct Fill_sub*); // NULL: wait in Fill_read/Fill_space instead
+	void* arg; // for wake
+	struct Fill_sub* next;
+}Fill_sub;
+
+/*
+ * a miss being fetched (single-flight): the first client to miss on a url
+ * leads, fetches, and tees the response into the fill as it comes in;
+ * clients that miss on the url meanwhile subscribe and are streamed the
+ * same bytes instead of fetching it again. The response is cached once it
+ * ends, unless it outgrew MAX_OBJECT_SIZE first. From then on nobody can
+ * join, and buf only holds the last MAX_OBJECT_SIZE bytes: the leader
+ * waits for the slowest subscriber before it reads more.
+ */
+typedef struct Cache_fill{
+	char* p_url;
+	unsigned hash;
+	struct Cache_shard* shard;
+	struct Cache_fill* f_next; // in flight in the same shard
+	int linked; // on shard->flight, still open to subscribers
+	pthread_mutex_t lock; // guards the rest
+	pthread_cond_t more; // bytes came in or the fill ended
+	pthread_cond_t room; // a subscriber moved on or left
+	char* buf; // byte i of the response at buf[i % MAX_OBJECT_SIZE]
+	int cap; // grows up to MAX_OBJECT_SIZE
+	long size; // bytes of the response so far
+	int cacheable; // size has stayed within MAX_OBJECT_SIZE
+	int state; // FILL_RUNNING, FILL_DONE or FILL_FAILED
+	Fill_sub* subs;
+	int n_subs;
+	Fill_sub* leader; // waiting in Fill_space
+	int refs; // the leader's and one per subscriber
+}Cache_fill;
+
+#define FILL_RUNNING 0
+#define FILL_DONE 1 // the whole response is in
+#define FILL_FAILED 2 // the leader gave up, what is in is all there will be
+
+Cache* Cache_init(void);
+int Search_and_Transfer(char* url, Cache* p_Cache, int fd, void** p_hit); // on a hit, send the object to fd, kept alive until Cache_release
+Cache_obj* Cache_lookup(Cache* p_Cache, char* url); // on a hit, the object, kept alive until Cache_release
+ssize_t Cache_send(Cache* p_Cache, Cache_obj* p, int fd, int off); // sendfile() of p from off on
+void Cache_release(Cache_obj* p);
+void Write_and_Update(Cache* p_Cache, int size, char* url, char* buf); // insert, evicting by CLOCK
+Cache_fill* Fill_join(Cache* p_Cache, char* url, Fill_sub* sub, int* p_leader); // NULL if url got cached meanwhile
+
+/* for the leader */
+long Fill_space(Cache_fill* f, Fill_sub* leader); // bytes it may append now, 0 if it has to wait
+int Fill_append(Cache_fill* f, char* buf, int n); // -1 if nobody needs the rest
+int Fill_shared(Cache_fill* f); // someone subscribed
+void Fill_end(Cache* p_Cache, Cache_fill* f, int ok); // ok: the whole response is in, cache it
+
+/* for a subscriber */
+int Fill_read(Cache_fill* f, Fill_sub* sub, char* buf, int n); // bytes read, 0 at the end, -1 if the leader failed
+void Fill_leave(Cache_fill* f, Fill_sub* sub);
+void Destroy_Cache(Cache* p_Cache);
+
+#endif /* __CACHE_H__ */
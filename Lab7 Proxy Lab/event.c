@@ -0,0 +1,1022 @@
+/*
+ * event.c - event-driven front end of the proxy
+ *
+ * One loop per core, each an epoll instance with a listening socket of
+ * its own: SO_REUSEPORT lets the kernel spread new connections over the
+ * loops, so nothing is shared on the accept path. Every socket is
+ * non-blocking and every client is a small state machine (Conn) that
+ * its loop steps whenever one of its sockets is ready:
+ *
+ *  C_REQUEST  read the request head from the client, at most
+ *             CLIENT_IDLE seconds
+ *  C_HIT      send the cached object
+ *  C_CONNECT  wait for the connection to the server
+ *  C_FORWARD  send the rebuilt request head to the server, on a new
+ *             connection or an idle one from the pool
+ *  C_RELAY    pass the response to the client as it arrives, decoded,
+ *             teeing it into the Cache_fill for the cache and for
+ *             clients following; the server connection goes back to
+ *             the pool once the response is all in
+ *  C_SPLICE   too big to cache and nobody following: splice() the rest
+ *             of a plain body through a pipe
+ *  C_FOLLOW   another client is fetching the same url: send what it
+ *             tees into its Cache_fill
+ *
+ * A client connection carries on with the next request once a response
+ * that says where it ends went out whole; requests the client pipelined
+ * wait in the Conn meanwhile. Conns waiting for a request sit on their
+ * loop's idle list, oldest first, and the loop's epoll_wait times out
+ * when the oldest has waited CLIENT_IDLE seconds.
+ *
+ * A fill wakes the clients waiting on it, which may be on other loops,
+ * through their loop's eventfd. A leader whose client hangs up goes on
+ * fetching as long as someone follows.
+ *
+ * A connection costs a Conn, not a thread and its stack; the relay
+ * buffer and the Cache_fill only exist during a miss. Hits go
+ * out with sendfile() from the cache's store and the tail of a large
+ * response with splice(), so neither is copied through the loop. Name
+ * lookups still block the loop, gethostbyname has no asynchronous form.
+ */
+#define _GNU_SOURCE // accept4
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "csapp.h"
+#include "cache.h"
+#include "proxy.h"
+#include "upstream.h"
+
+#define MAX_EVENTS 64 // per epoll_wait
+#define RELAY_SIZE 16384
+#define SPLICE_SIZE 65536 // a pipe's default capacity
+
+enum { C_REQUEST, C_HIT, C_CONNECT, C_FORWARD, C_RELAY, C_SPLICE, C_FOLLOW, C_CLOSED };
+
+typedef struct Conn Conn;
+typedef struct Loop Loop;
+
+/* what epoll hands back: one socket of a Conn */
+typedef struct Ev{
+	Conn* c; // NULL for the loop's eventfd
+	int fd;
+	int events; // interest set now registered
+}Ev;
+
+struct Conn{
+	int state;
+	Loop* loop;
+	Ev client; // fd is -1 once a leader's client hung up
+	Ev server; // fd is -1 until the miss connects
+	char head[RIO_BUFSIZE]; // request head from the client, then the one for the server
+	int head_len, head_off;
+	char* pending; // what the client sent past the head: requests it pipelined
+	int pending_len;
+	int keep; // the client wants the connection kept
+	int framed; // the response says where it ends; -1 until its head is out
+	long idle_since; // on the idle list since, in ms
+	int idle; // on the idle list
+	Conn* idle_prev;
+	Conn* idle_next;
+	char* url; // cache key
+	char* host;
+	int port;
+	int reused; // server came from the pool and nothing came back on it yet
+	Cache_obj* hit;
+	int hit_off;
+	char* relay; // response bytes read from the server, decoded
+	int relay_len, relay_off;
+	Resp* resp;
+	Cache_fill* fill; // the miss being fetched, NULL once nobody else needs it
+	int leader; // c fetches it, else c follows
+	Fill_sub sub; // c's place in fill, and how it wakes c
+	int queued; // on loop->woken
+	Conn* next_woken;
+	int pipe[2]; // C_SPLICE: server to pipe[1], pipe[0] to client; -2 if there was none to be had
+	int pipe_len; // bytes in the pipe
+	Conn* next_dead;
+};
+
+struct Loop{
+	int epfd;
+	int listenfd;
+	Cache* p_Cache;
+	Conn* dead; // closed during this round of events, freed after it
+	Ev wake; // eventfd, written when woken gets a Conn
+	pthread_mutex_t wake_lock; // guards woken and every Conn's queued
+	Conn* woken; // fills woke them, from any loop
+	Conn* idle_head; // waiting for a request, oldest first
+	Conn* idle_tail;
+};
+
+static void* loop(void* arg);
+static void accept_all(Loop* l);
+static void step(Loop* l, Conn* c);
+static int read_request(Loop* l, Conn* c);
+static char* head_end(char* head);
+static int start_request(Loop* l, Conn* c);
+static int send_hit(Loop* l, Conn* c);
+static int forward(Loop* l, Conn* c);
+static int relay(Loop* l, Conn* c);
+static int splice_relay(Loop* l, Conn* c);
+static int follow(Loop* l, Conn* c);
+static void wake(Fill_sub* sub);
+static void run_woken(Loop* l);
+static void client_gone(Loop* l, Conn* c);
+static void watch(Loop* l, Ev* e, int events);
+static int reconnect(Loop* l, Conn* c);
+static void server_done(Loop* l, Conn* c);
+static int next_request(Loop* l, Conn* c);
+static void end_request(Loop* l, Conn* c);
+static void close_conn(Loop* l, Conn* c);
+static long now_ms(void);
+static void idle_add(Loop* l, Conn* c);
+static void idle_del(Loop* l, Conn* c);
+static int open_listenfd_reuseport(int port);
+static int connect_server(char* host, int port);
+
+/*
+ * Event_loops - run one loop per online core, the last one in the
+ * calling thread
+ */
+void Event_loops(int port, Cache* p_Cache)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	pthread_t tid;
+	Loop* l;
+	long i;
+
+	if(n < 1)
+		n = 1;
+	for(i = 0; i < n; i++)
+	{
+		l = Malloc(sizeof(struct Loop));
+		l->epfd = epoll_create1(0);
+		if(l->epfd < 0)
+			unix_error("epoll_create1 error");
+		l->listenfd = open_listenfd_reuseport(port);
+		l->p_Cache = p_Cache;
+		l->dead = NULL;
+		if((l->wake.fd = eventfd(0, EFD_NONBLOCK)) < 0)
+			unix_error("eventfd error");
+		l->wake.c = NULL;
+		l->wake.events = -1;
+		pthread_mutex_init(&l->wake_lock, NULL);
+		l->woken = NULL;
+		l->idle_head = l->idle_tail = NULL;
+		if(i < n - 1)
+			Pthread_create(&tid, NULL, loop, l);
+	}
+	loop(l);
+}
+
+static void* loop(void* arg)
+{
+	Loop* l = arg;
+	struct epoll_event ev[MAX_EVENTS];
+	struct epoll_event lev;
+	Conn* c;
+	int i, n, timeout;
+	long now;
+
+	lev.events = EPOLLIN;
+	lev.data.ptr = NULL; // NULL is the listening socket
+	if(epoll_ctl(l->epfd, EPOLL_CTL_ADD, l->listenfd, &lev) < 0)
+		unix_error("epoll_ctl error");
+	watch(l, &l->wake, EPOLLIN);
+
+	while(1)
+	{
+		timeout = -1;
+		if(l->idle_head != NULL && (timeout = l->idle_head->idle_since + CLIENT_IDLE * 1000L - now_ms()) < 0)
+			timeout = 0;
+		if((n = epoll_wait(l->epfd, ev, MAX_EVENTS, timeout)) < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			unix_error("epoll_wait error");
+		}
+		for(i = 0; i < n; i++)
+		{
+			if(ev[i].data.ptr == NULL)
+				accept_all(l);
+			else if(ev[i].data.ptr == &l->wake)
+				run_woken(l);
+			else if((c = ((Ev*)ev[i].data.ptr)->c)->state == C_CLOSED)
+				continue;
+			else if(ev[i].data.ptr == &c->client && (ev[i].events & (EPOLLERR | EPOLLHUP)))
+				client_gone(l, c);
+			else
+				step(l, c);
+		}
+		now = now_ms();
+		while(l->idle_head != NULL && now - l->idle_head->idle_since >= CLIENT_IDLE * 1000L)
+			close_conn(l, l->idle_head);
+		while((c = l->dead) != NULL) // nothing of this round refers to them any more
+		{
+			l->dead = c->next_dead;
+			Free(c);
+		}
+	}
+	return NULL;
+}
+
+static void accept_all(Loop* l)
+{
+	Conn* c;
+	int fd;
+
+	while((fd = accept4(l->listenfd, NULL, NULL, SOCK_NONBLOCK)) >= 0)
+	{
+		c = Malloc(sizeof(struct Conn));
+		c->state = C_REQUEST;
+		c->loop = l;
+		c->client.c = c->server.c = c;
+		c->client.fd = fd;
+		c->client.events = -1;
+		c->server.fd = -1;
+		c->server.events = -1;
+		c->head_len = c->head_off = 0;
+		c->pending = NULL;
+		c->idle = 0;
+		c->url = NULL;
+		c->host = NULL;
+		c->hit = NULL;
+		c->relay = NULL;
+		c->resp = NULL;
+		c->fill = NULL;
+		c->sub.wake = wake;
+		c->sub.arg = c;
+		c->queued = 0;
+		c->pipe[0] = c->pipe[1] = -1;
+		idle_add(l, c);
+		watch(l, &c->client, EPOLLIN);
+	}
+	if(errno != EAGAIN && errno != EWOULDBLOCK)
+		fprintf(stderr, "accept4 error: %s\n", strerror(errno));
+}
+
+/*
+ * step - run c until it has to wait for one of its sockets. Every state
+ * returns 1 to go on with the state it moved to, 0 once it waits.
+ */
+static void step(Loop* l, Conn* c)
+{
+	int more;
+
+	do
+	{
+		switch(c->state)
+		{
+		case C_REQUEST:
+			more = read_request(l, c);
+			break;
+		case C_HIT:
+			more = send_hit(l, c);
+			break;
+		case C_CONNECT:
+		case C_FORWARD:
+			more = forward(l, c);
+			break;
+		case C_RELAY:
+			more = relay(l, c);
+			break;
+		case C_SPLICE:
+			more = splice_relay(l, c);
+			break;
+		case C_FOLLOW:
+			more = follow(l, c);
+			break;
+		default:
+			more = 0;
+		}
+	}while(more);
+}
+
+/*
+ * read_request - read until the blank line that ends the head; what
+ * comes after it is kept for the next request
+ */
+static int read_request(Loop* l, Conn* c)
+{
+	char* end;
+	int n;
+
+	while(1)
+	{
+		c->head[c->head_len] = '\0';
+		if((end = head_end(c->head)) != NULL)
+		{
+			if((c->pending_len = c->head + c->head_len - end) > 0)
+			{
+				c->pending = Malloc(c->pending_len);
+				memcpy(c->pending, end, c->pending_len);
+			}
+			c->head_len = end - c->head;
+			c->head[c->head_len] = '\0';
+			return start_request(l, c);
+		}
+		if(c->head_len == sizeof(c->head) - 1) // no room for the rest of the head
+		{
+			close_conn(l, c);
+			return 0;
+		}
+		n = read(c->client.fd, c->head + c->head_len, sizeof(c->head) - 1 - c->head_len);
+		if(n > 0)
+			c->head_len += n;
+		else if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			watch(l, &c->client, EPOLLIN);
+			return 0;
+		}
+		else
+		{
+			if(n < 0)
+				fprintf(stderr, "read_request error: %s\n", strerror(errno));
+			close_conn(l, c);
+			return 0;
+		}
+	}
+}
+
+/* head_end - just past the blank line that ends head, NULL if it is not there yet */
+static char* head_end(char* head)
+{
+	char* crlf = strstr(head, "\n\r\n");
+	char* lf = strstr(head, "\n\n");
+
+	if(lf != NULL && (crlf == NULL || lf < crlf))
+		return lf + 2;
+	return crlf != NULL ? crlf + 3 : NULL;
+}
+
+/*
+ * start_request - the head is in: serve a hit, or rebuild the request as
+ * doit() does and start connecting to the server
+ */
+static int start_request(Loop* l, Conn* c)
+{
+	char buf[MAXLINE], method[10] = "", url[MAXLINE] = "", uri[MAXLINE], host[MAXLINE], version[16] = "";
+	char request_header[MAXLINE] = "";
+	char request_port[10] = "";
+	int port, rc;
+	rio_t rio;
+
+	idle_del(l, c);
+	c->framed = -1;
+	sscanf(c->head, "%9s %s %15s", method, url, version);
+	if(strcasecmp(method, "GET"))
+	{
+		clienterror(c->client.fd, method, "501", "Not Implemented","Proxy doesn't implement this request type");
+		close_conn(l, c);
+		return 0;
+	}
+	parse_url(url, request_port, host, uri);
+	port = !strlen(request_port) ? 80 : atoi(request_port);
+	if(snprintf(url, sizeof(url), "%s:%d%s", host, port, uri) >= (int)sizeof(url)) // no room for the cache key
+	{
+		clienterror(c->client.fd, method, "414", "URI Too Long", "Proxy can't handle a url this long");
+		close_conn(l, c);
+		return 0;
+	}
+	c->url = Malloc(strlen(url) + 1);
+	strcpy(c->url, url);
+
+	/* the whole head is buffered, so parsing it from memory never reads */
+	rio.rio_fd = -1;
+	rio.rio_cnt = c->head_len;
+	rio.rio_bufptr = rio.rio_buf;
+	memcpy(rio.rio_buf, c->head, c->head_len);
+	Rio_readlineb(&rio, buf, MAXLINE); // request line, already parsed
+	if((rc = parse_build_requesthead(&rio, request_header, host, port)) < 0) // too long for request_header
+	{
+		close_conn(l, c);
+		return 0;
+	}
+	c->keep = !rc && !strcmp(version, "HTTP/1.1");
+
+	while((c->hit = Cache_lookup(l->p_Cache, c->url)) == NULL &&
+	      (c->fill = Fill_join(l->p_Cache, c->url, &c->sub, &c->leader)) == NULL)
+		; // cached since the lookup
+	if(c->hit != NULL)
+	{
+		c->framed = Resp_framed(c->hit->response_body, c->hit->obj_size);
+		c->hit_off = 0;
+		c->state = C_HIT;
+		return 1;
+	}
+	if(!c->leader)
+	{
+		c->relay = Malloc(RELAY_SIZE);
+		c->relay_len = c->relay_off = 0;
+		c->state = C_FOLLOW;
+		return 1;
+	}
+
+	c->head_len = snprintf(c->head, sizeof(c->head), "GET %s HTTP/1.1\r\n%s", uri, request_header);
+	if(c->head_len >= (int)sizeof(c->head))
+	{
+		close_conn(l, c);
+		return 0;
+	}
+	c->head_off = 0;
+	c->host = Malloc(strlen(host) + 1);
+	strcpy(c->host, host);
+	c->port = port;
+
+	watch(l, &c->client, 0);
+	if((c->reused = (rc = Pool_get(host, port)) >= 0))
+	{
+		c->server.fd = rc;
+		c->state = C_FORWARD;
+		return 1;
+	}
+	if((rc = connect_server(host, port)) < 0)
+	{
+		if(rc == -1)
+			fprintf(stderr, "connect_server error: %s\n", strerror(errno));
+		else
+			clienterror(c->client.fd, host, "Error ", "DNS error", "Invalid domain name ");
+		close_conn(l, c);
+		return 0;
+	}
+	c->server.fd = rc;
+	c->state = C_CONNECT;
+	watch(l, &c->server, EPOLLOUT);
+	return 0;
+}
+
+static int send_hit(Loop* l, Conn* c)
+{
+	ssize_t n;
+
+	while(c->hit_off < c->hit->obj_size)
+	{
+		n = Cache_send(l->p_Cache, c->hit, c->client.fd, c->hit_off);
+		if(n < 0)
+		{
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				watch(l, &c->client, EPOLLOUT);
+				return 0;
+			}
+			fprintf(stderr, "send_hit error: %s\n", strerror(errno));
+			break;
+		}
+		c->hit_off += n;
+	}
+	if(c->hit_off == c->hit->obj_size)
+		return next_request(l, c);
+	close_conn(l, c);
+	return 0;
+}
+
+/* forward - finish connecting, then send the request head to the server */
+static int forward(Loop* l, Conn* c)
+{
+	int n, err;
+	socklen_t len = sizeof(err);
+
+	if(c->state == C_CONNECT)
+	{
+		if(getsockopt(c->server.fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0)
+		{
+			fprintf(stderr, "connect_server error: %s\n", strerror(err));
+			close_conn(l, c);
+			return 0;
+		}
+		c->state = C_FORWARD;
+	}
+	while(c->head_off < c->head_len)
+	{
+		n = write(c->server.fd, c->head + c->head_off, c->head_len - c->head_off);
+		if(n < 0)
+		{
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				watch(l, &c->server, EPOLLOUT);
+				return 0;
+			}
+			if(c->reused) // closed while it sat in the pool
+				return reconnect(l, c);
+			fprintf(stderr, "forward error: %s\n", strerror(errno));
+			close_conn(l, c);
+			return 0;
+		}
+		c->head_off += n;
+	}
+	if(c->relay == NULL)
+	{
+		c->relay = Malloc(RELAY_SIZE + RESP_HEAD_MAX);
+		c->resp = Malloc(sizeof(struct Resp));
+		Resp_init(c->resp);
+	}
+	c->relay_len = c->relay_off = 0;
+	c->state = C_RELAY;
+	return 1;
+}
+
+/*
+ * relay - read from the server only once the client took everything read
+ * so far, so a slow client holds one RELAY_SIZE buffer, not the response;
+ * nor more than the fill has room for, so the slowest follower holds it
+ */
+static int relay(Loop* l, Conn* c)
+{
+	char raw[RELAY_SIZE];
+	long space = RELAY_SIZE;
+	int n;
+
+	while(1)
+	{
+		if(c->fill == NULL && c->client.fd < 0) // nobody left to send it to
+		{
+			close_conn(l, c);
+			return 0;
+		}
+		if(c->fill == NULL && c->relay_off == c->relay_len && c->pipe[0] < 0 && Resp_plain(c->resp))
+		{
+			if(pipe2(c->pipe, O_NONBLOCK) == 0) // else go on copying
+			{
+				Free(c->relay);
+				c->relay = NULL;
+				c->pipe_len = 0;
+				c->state = C_SPLICE;
+				return 1;
+			}
+			c->pipe[0] = -2;
+		}
+		if(c->relay_off < c->relay_len && c->client.fd < 0)
+			c->relay_off = c->relay_len;
+		if(c->relay_off < c->relay_len)
+		{
+			n = write(c->client.fd, c->relay + c->relay_off, c->relay_len - c->relay_off);
+			if(n < 0)
+			{
+				if(errno == EAGAIN || errno == EWOULDBLOCK)
+				{
+					watch(l, &c->server, 0);
+					watch(l, &c->client, EPOLLOUT);
+					return 0;
+				}
+				fprintf(stderr, "relay error: %s\n", strerror(errno));
+				client_gone(l, c);
+				if(c->state == C_CLOSED)
+					return 0;
+				continue;
+			}
+			c->relay_off += n;
+			continue;
+		}
+		if(c->server.fd < 0) // the whole response went out
+			return next_request(l, c);
+		if(c->fill != NULL && (space = Fill_space(c->fill, &c->sub)) == 0) // the fill wakes c
+		{
+			watch(l, &c->client, 0);
+			watch(l, &c->server, 0);
+			return 0;
+		}
+		n = read(c->server.fd, raw, space < RELAY_SIZE ? space : RELAY_SIZE);
+		if(n > 0)
+		{
+			c->reused = 0;
+			if((c->relay_len = Resp_decode(c->resp, raw, n, c->relay)) < 0)
+			{
+				fprintf(stderr, "bad response from %s\n", c->host);
+				if(c->resp->state == RESP_HEAD && c->client.fd >= 0) // nothing sent yet
+					clienterror(c->client.fd, c->host, "502", "Bad Gateway", "Proxy got a bad response");
+				close_conn(l, c);
+				return 0;
+			}
+			c->relay_off = 0;
+			if(c->framed < 0 && c->relay_len > 0) // the head comes out all at once
+				c->framed = Resp_framed(c->relay, c->relay_len);
+			if(c->fill != NULL && Fill_append(c->fill, c->relay, c->relay_len) < 0) // too big to cache, nobody follows
+			{
+				Fill_end(l->p_Cache, c->fill, 0);
+				c->fill = NULL;
+			}
+			if(c->resp->state == RESP_DONE)
+			{
+				if(c->fill != NULL) // cached if it fits
+				{
+					Fill_end(l->p_Cache, c->fill, 1);
+					c->fill = NULL;
+				}
+				server_done(l, c);
+			}
+		}
+		else if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			watch(l, &c->client, 0);
+			watch(l, &c->server, EPOLLIN);
+			return 0;
+		}
+		else
+		{
+			if(c->reused) // closed while it sat in the pool
+				return reconnect(l, c);
+			if(n < 0)
+				fprintf(stderr, "relay error: %s\n", strerror(errno));
+			else if(Resp_eof(c->resp) && c->fill != NULL) // the whole response: cached if it fits
+			{
+				Fill_end(l->p_Cache, c->fill, 1);
+				c->fill = NULL;
+			}
+			if(c->resp->state == RESP_HEAD && c->client.fd >= 0) // the server went away before the head: nothing sent yet
+				clienterror(c->client.fd, c->host, "502", "Bad Gateway", "Proxy got no response");
+			close_conn(l, c);
+			return 0;
+		}
+	}
+}
+
+/*
+ * splice_relay - move the rest of the response through the pipe; the
+ * pipe is only refilled once the client took everything in it
+ */
+static int splice_relay(Loop* l, Conn* c)
+{
+	ssize_t n;
+
+	while(1)
+	{
+		if(c->pipe_len > 0)
+		{
+			n = splice(c->pipe[0], NULL, c->client.fd, NULL, c->pipe_len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			if(n < 0)
+			{
+				if(errno == EAGAIN)
+				{
+					watch(l, &c->server, 0);
+					watch(l, &c->client, EPOLLOUT);
+					return 0;
+				}
+				fprintf(stderr, "splice_relay error: %s\n", strerror(errno));
+				close_conn(l, c);
+				return 0;
+			}
+			c->pipe_len -= n;
+			continue;
+		}
+		if(c->resp->state == RESP_DONE) // and all of it went out
+		{
+			server_done(l, c);
+			return next_request(l, c);
+		}
+		n = c->resp->left >= 0 && c->resp->left < SPLICE_SIZE ? c->resp->left : SPLICE_SIZE;
+		n = splice(c->server.fd, NULL, c->pipe[1], NULL, n, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if(n > 0)
+		{
+			c->pipe_len = n;
+			Resp_skip(c->resp, n);
+		}
+		else if(n < 0 && errno == EAGAIN)
+		{
+			watch(l, &c->client, 0);
+			watch(l, &c->server, EPOLLIN);
+			return 0;
+		}
+		else
+		{
+			if(n < 0)
+				fprintf(stderr, "splice_relay error: %s\n", strerror(errno));
+			close_conn(l, c);
+			return 0;
+		}
+	}
+}
+
+/* follow - send the client what the leader tees into the fill */
+static int follow(Loop* l, Conn* c)
+{
+	int n;
+
+	while(1)
+	{
+		if(c->relay_off < c->relay_len)
+		{
+			n = write(c->client.fd, c->relay + c->relay_off, c->relay_len - c->relay_off);
+			if(n < 0)
+			{
+				if(errno == EAGAIN || errno == EWOULDBLOCK)
+				{
+					watch(l, &c->client, EPOLLOUT);
+					return 0;
+				}
+				fprintf(stderr, "follow error: %s\n", strerror(errno));
+				close_conn(l, c);
+				return 0;
+			}
+			c->relay_off += n;
+			continue;
+		}
+		n = Fill_read(c->fill, &c->sub, c->relay, RELAY_SIZE);
+		if(n > 0)
+		{
+			if(c->sub.off == n) // the head comes first, all at once
+				c->framed = Resp_framed(c->relay, n);
+			c->relay_len = n;
+			c->relay_off = 0;
+		}
+		else if(n == FILL_WAIT) // the fill wakes c
+		{
+			watch(l, &c->client, 0);
+			return 0;
+		}
+		else if(n == 0)
+			return next_request(l, c);
+		else
+		{
+			if(c->sub.off == 0) // the fetch failed before anything came
+				clienterror(c->client.fd, c->url, "502", "Bad Gateway", "Proxy couldn't fetch the object");
+			close_conn(l, c);
+			return 0;
+		}
+	}
+}
+
+/* wake - a fill has news for the Conn of sub; called from any loop, fill locked */
+static void wake(Fill_sub* sub)
+{
+	Conn* c = sub->arg;
+	Loop* l = c->loop;
+	uint64_t one = 1;
+
+	pthread_mutex_lock(&l->wake_lock);
+	if(!c->queued)
+	{
+		c->queued = 1;
+		c->next_woken = l->woken;
+		l->woken = c;
+	}
+	pthread_mutex_unlock(&l->wake_lock);
+	if(write(l->wake.fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+		fprintf(stderr, "wake error: %s\n", strerror(errno));
+}
+
+/* run_woken - step every Conn woken since last time */
+static void run_woken(Loop* l)
+{
+	uint64_t n;
+	Conn* c;
+	Conn* next;
+
+	if(read(l->wake.fd, &n, sizeof(n)) < 0 && errno != EAGAIN)
+		fprintf(stderr, "run_woken error: %s\n", strerror(errno));
+	pthread_mutex_lock(&l->wake_lock);
+	c = l->woken;
+	l->woken = NULL;
+	for(next = c; next != NULL; next = next->next_woken)
+		next->queued = 0;
+	pthread_mutex_unlock(&l->wake_lock);
+	for(; c != NULL; c = next)
+	{
+		next = c->next_woken;
+		if(c->state != C_CLOSED)
+			step(l, c);
+		else // closed while queued, left to us to free
+		{
+			c->next_dead = l->dead;
+			l->dead = c;
+		}
+	}
+}
+
+/*
+ * client_gone - the client hung up or its socket failed. A leader goes on
+ * fetching for the clients following it, everything else is closed.
+ */
+static void client_gone(Loop* l, Conn* c)
+{
+	if(c->state == C_RELAY && c->fill != NULL && Fill_shared(c->fill))
+	{
+		Close(c->client.fd);
+		c->client.fd = -1;
+	}
+	else
+		close_conn(l, c);
+}
+
+/* watch - register e or change what it waits for, level-triggered */
+static void watch(Loop* l, Ev* e, int events)
+{
+	struct epoll_event ev;
+
+	if(e->events == events || e->fd < 0)
+		return;
+	ev.events = events;
+	ev.data.ptr = e;
+	if(epoll_ctl(l->epfd, e->events < 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, e->fd, &ev) < 0)
+		unix_error("epoll_ctl error");
+	e->events = events;
+}
+
+/*
+ * reconnect - the pooled connection c sent the request on was closed by
+ * the server before anything came back: send it again on a new one
+ */
+static int reconnect(Loop* l, Conn* c)
+{
+	int rc;
+
+	Close(c->server.fd); // which takes it out of the epoll set
+	c->server.fd = -1;
+	c->server.events = -1;
+	c->reused = 0;
+	c->head_off = 0;
+	if((rc = connect_server(c->host, c->port)) < 0)
+	{
+		fprintf(stderr, "connect_server error: %s\n", strerror(errno));
+		close_conn(l, c);
+		return 0;
+	}
+	c->server.fd = rc;
+	c->state = C_CONNECT;
+	watch(l, &c->client, 0);
+	watch(l, &c->server, EPOLLOUT);
+	return 0;
+}
+
+/* server_done - the response is all in: the server connection goes back to the pool, if the server keeps it */
+static void server_done(Loop* l, Conn* c)
+{
+	if(c->resp->keep)
+	{
+		if(c->server.events >= 0 && epoll_ctl(l->epfd, EPOLL_CTL_DEL, c->server.fd, NULL) < 0)
+			unix_error("epoll_ctl error");
+		Pool_put(c->host, c->port, c->server.fd);
+	}
+	else
+		Close(c->server.fd);
+	c->server.fd = -1;
+	c->server.events = -1;
+}
+
+/*
+ * next_request - the response went out whole: wait for the client's
+ * next request, unless the connection ends here
+ */
+static int next_request(Loop* l, Conn* c)
+{
+	if(!c->keep || c->framed != 1)
+	{
+		close_conn(l, c);
+		return 0;
+	}
+	end_request(l, c);
+	c->head_len = c->head_off = 0;
+	if(c->pending != NULL)
+	{
+		memcpy(c->head, c->pending, c->pending_len);
+		c->head_len = c->pending_len;
+		Free(c->pending);
+		c->pending = NULL;
+	}
+	c->state = C_REQUEST;
+	idle_add(l, c);
+	return 1;
+}
+
+/* end_request - let go of everything c took for the request */
+static void end_request(Loop* l, Conn* c)
+{
+	if(c->fill != NULL && c->leader)
+		Fill_end(l->p_Cache, c->fill, 0);
+	else if(c->fill != NULL)
+		Fill_leave(c->fill, &c->sub); // no wake for c from here on
+	c->fill = NULL;
+	if(c->server.fd >= 0)
+		Close(c->server.fd);
+	c->server.fd = -1;
+	c->server.events = -1;
+	if(c->hit != NULL)
+		Cache_release(c->hit);
+	c->hit = NULL;
+	if(c->url != NULL)
+		Free(c->url);
+	c->url = NULL;
+	if(c->host != NULL)
+		Free(c->host);
+	c->host = NULL;
+	if(c->relay != NULL)
+		Free(c->relay);
+	c->relay = NULL;
+	if(c->resp != NULL)
+		Free(c->resp);
+	c->resp = NULL;
+	if(c->pipe[0] >= 0)
+	{
+		Close(c->pipe[0]);
+		Close(c->pipe[1]);
+	}
+	c->pipe[0] = c->pipe[1] = -1;
+}
+
+/*
+ * close_conn - close c's sockets now, free c once this round of events is
+ * done, or once run_woken has taken it off the queue
+ */
+static void close_conn(Loop* l, Conn* c)
+{
+	end_request(l, c);
+	idle_del(l, c);
+	if(c->client.fd >= 0)
+		Close(c->client.fd);
+	if(c->pending != NULL)
+		Free(c->pending);
+	pthread_mutex_lock(&l->wake_lock);
+	c->state = C_CLOSED;
+	if(!c->queued)
+	{
+		c->next_dead = l->dead;
+		l->dead = c;
+	}
+	pthread_mutex_unlock(&l->wake_lock);
+}
+
+static long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+/* idle_add - c waits for a request from now on: to the tail of the idle list */
+static void idle_add(Loop* l, Conn* c)
+{
+	c->idle = 1;
+	c->idle_since = now_ms();
+	c->idle_next = NULL;
+	c->idle_prev = l->idle_tail;
+	if(l->idle_tail != NULL)
+		l->idle_tail->idle_next = c;
+	else
+		l->idle_head = c;
+	l->idle_tail = c;
+}
+
+static void idle_del(Loop* l, Conn* c)
+{
+	if(!c->idle)
+		return;
+	c->idle = 0;
+	if(c->idle_prev != NULL)
+		c->idle_prev->idle_next = c->idle_next;
+	else
+		l->idle_head = c->idle_next;
+	if(c->idle_next != NULL)
+		c->idle_next->idle_prev = c->idle_prev;
+	else
+		l->idle_tail = c->idle_prev;
+}
+
+/* open_listenfd_reuseport - Open_listenfd, non-blocking and shared by every loop */
+static int open_listenfd_reuseport(int port)
+{
+	int listenfd, optval = 1;
+	struct sockaddr_in serveraddr;
+
+	if((listenfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0)
+		unix_error("open_listenfd_reuseport error");
+	if(setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(int)) < 0 ||
+	   setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(int)) < 0)
+		unix_error("open_listenfd_reuseport error");
+
+	bzero((char *) &serveraddr, sizeof(serveraddr));
+	serveraddr.sin_family = AF_INET;
+	serveraddr.sin_addr.s_addr = htonl(INADDR_ANY);
+	serveraddr.sin_port = htons((unsigned short)port);
+	if(bind(listenfd, (SA *)&serveraddr, sizeof(serveraddr)) < 0 || listen(listenfd, LISTENQ) < 0)
+		unix_error("open_listenfd_reuseport error");
+	return listenfd;
+}
+
+/*
+ * connect_server - open_clientfd_my with a non-blocking socket: the
+ * connection is still in progress when it returns. -2 if host is unknown.
+ */
+static int connect_server(char* host, int port)
+{
+	int serverfd;
+	struct hostent* hp;
+	struct sockaddr_in serveraddr;
+
+	if((hp = Gethostbyname_my(host)) == NULL)
+		return -2;
+	bzero((char *) &serveraddr, sizeof(serveraddr));
+	serveraddr.sin_family = AF_INET;
+	bcopy((char *)hp->h_addr_list[0], (char *)&serveraddr.sin_addr.s_addr, hp->h_length);
+	serveraddr.sin_port = htons(port);
+	Free(hp);
+
+	if((serverfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0)
+		return -1;
+	if(connect(serverfd, (SA *)&serveraddr, sizeof(serveraddr)) < 0 && errno != EINPROGRESS)
+	{
+		Close(serverfd);
+		return -1;
+	}
+	return serverfd;
+}
@@ -0,0 +1,18 @@
+#ifndef __PROXY_H__
+#define __PROXY_H__
+
+#include "csapp.h"
+#include "cache.h"
+
+/* request parsing and error pages, in zkb.c */
+void parse_url(char*, char*, char*, char*);
+int parse_build_requesthead(rio_t*, char*, char*, int); // 1 if the client asked to close the connection, -1 if the head is cut short or too long
+void clienterror(int, char*, char*, char*, char*);
+struct hostent *Gethostbyname_my(const char*);// thread-safe Wrapper function
+
+#define CLIENT_IDLE 5 // seconds a client connection may wait for its next request, or go quiet in the middle of one
+
+/* event-driven front end, in event.c */
+void Event_loops(int port, Cache* p_Cache); // one loop per core, never returns
+
+#endif /* __PROXY_H__ */
@@ -0,0 +1,22 @@
+#ifndef __SBUF_H__
+#define __SBUF_H__
+
+#include "csapp.h"
+
+/* bounded FIFO of connected descriptors, from the acceptor to the workers */
+typedef struct{
+	int* buf; // n slots
+	int n;
+	int front; // buf[(front+1)%n] is the first item
+	int rear; // buf[rear%n] is the last item
+	sem_t mutex; // protects buf, front and rear
+	sem_t slots; // free slots
+	sem_t items; // available items
+}sbuf_t;
+
+void sbuf_init(sbuf_t* sp, int n);
+void sbuf_deinit(sbuf_t* sp);
+void sbuf_insert(sbuf_t* sp, int item); // waits while the buffer is full
+int sbuf_remove(sbuf_t* sp); // waits while the buffer is empty
+
+#endif /* __SBUF_H__ */
@@ -0,0 +1,342 @@
+#define _GNU_SOURCE // strcasestr
+#include "upstream.h"
+
+/* an idle connection in the pool */
+typedef struct Idle{
+	char* host;
+	int port;
+	int fd;
+	time_t since; // put back then
+	struct Idle* h_next; // same bucket, most recent first
+	struct Idle* prev; // all of them, most recent first
+	struct Idle* next;
+}Idle;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER; // guards the rest
+static Idle* bucket[POOL_BUCKETS];
+static Idle lru = { .prev = &lru, .next = &lru }; // list head
+static int n_idle;
+
+static unsigned pool_hash(char* host, int port);
+static void pool_unlink(Idle* p);
+static void pool_drop(Idle* p);
+static int is_header(char* line, char* name);
+static int has_token(char* line, int n, char* token);
+static int head_done(Resp* r, char* out);
+
+int Pool_get(char* host, int port)
+{
+	Idle* p;
+	int fd;
+	char c;
+
+	while(1)
+	{
+		pthread_mutex_lock(&pool_lock);
+		while(lru.prev != &lru && time(NULL) - lru.prev->since >= POOL_IDLE)
+			pool_drop(lru.prev);
+		for(p = bucket[pool_hash(host, port)]; p != NULL; p = p->h_next)
+			if(p->port == port && !strcmp(p->host, host))
+				break;
+		if(p != NULL)
+			pool_unlink(p);
+		pthread_mutex_unlock(&pool_lock);
+		if(p == NULL)
+			return -1;
+		fd = p->fd;
+		Free(p->host);
+		Free(p);
+		/* an idle connection has nothing to read: EOF or stray bytes, and the server is done with it */
+		if(recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return fd;
+		Close(fd);
+	}
+}
+
+void Pool_put(char* host, int port, int fd)
+{
+	Idle* p = Malloc(sizeof(struct Idle));
+	Idle** head;
+
+	p->host = Malloc(strlen(host) + 1);
+	strcpy(p->host, host);
+	p->port = port;
+	p->fd = fd;
+	p->since = time(NULL);
+	pthread_mutex_lock(&pool_lock);
+	while(lru.prev != &lru && (n_idle == POOL_MAX || p->since - lru.prev->since >= POOL_IDLE))
+		pool_drop(lru.prev);
+	head = &bucket[pool_hash(host, port)];
+	p->h_next = *head;
+	*head = p;
+	p->prev = &lru;
+	p->next = lru.next;
+	lru.next->prev = p;
+	lru.next = p;
+	n_idle++;
+	pthread_mutex_unlock(&pool_lock);
+}
+
+void Resp_init(Resp* r)
+{
+	r->state = RESP_HEAD;
+	r->head_len = 0;
+	r->left = -1;
+	r->line_len = 0;
+	r->keep = 0;
+	r->got = 0;
+}
+
+/*
+ * Resp_decode - the next n bytes from the server, decoded into out. The
+ * head comes out at once when it is all in, so out may get more than n.
+ */
+int Resp_decode(Resp* r, char* in, int n, char* out)
+{
+	int i = 0, len = 0, k, rc, empty;
+	char* end;
+
+	r->got += n;
+	while(i < n)
+	{
+		switch(r->state)
+		{
+		case RESP_HEAD:
+			if(r->head_len == RESP_HEAD_MAX - 1) // too big
+				return -1;
+			r->head[r->head_len++] = in[i++];
+			if(r->head_len >= 2 && r->head[r->head_len - 1] == '\n' &&
+			   (r->head[r->head_len - 2] == '\n' || (r->head_len >= 3 && !memcmp(r->head + r->head_len - 3, "\n\r\n", 3))))
+			{
+				if((rc = head_done(r, out + len)) < 0)
+					return -1;
+				len += rc;
+			}
+			break;
+		case RESP_BODY:
+		case RESP_DATA:
+			k = n - i;
+			if(r->left >= 0 && k > r->left)
+				k = r->left;
+			memcpy(out + len, in + i, k);
+			len += k;
+			i += k;
+			if(r->left >= 0 && (r->left -= k) == 0)
+				r->state = r->state == RESP_BODY ? RESP_DONE : RESP_DATA_END;
+			break;
+		case RESP_SIZE:
+		case RESP_DATA_END:
+		case RESP_TRAILER:
+			if(in[i] != '\n')
+			{
+				if(r->line_len < (int)sizeof(r->line) - 1)
+					r->line[r->line_len++] = in[i];
+				i++;
+				break;
+			}
+			i++;
+			r->line[r->line_len] = '\0';
+			empty = r->line_len == 0 || !strcmp(r->line, "\r");
+			r->line_len = 0;
+			if(r->state == RESP_SIZE)
+			{
+				r->left = strtol(r->line, &end, 16);
+				if(end == r->line || r->left < 0)
+					return -1;
+				r->state = r->left == 0 ? RESP_TRAILER : RESP_DATA;
+			}
+			else if(r->state == RESP_DATA_END)
+			{
+				if(!empty)
+					return -1;
+				r->state = RESP_SIZE;
+			}
+			else if(empty) // trailer fields are dropped with the chunking
+				r->state = RESP_DONE;
+			break;
+		default: // more than the response: who knows what state the connection is in
+			r->keep = 0;
+			i = n;
+		}
+	}
+	return len;
+}
+
+int Resp_plain(Resp* r)
+{
+	return r->state == RESP_BODY;
+}
+
+void Resp_skip(Resp* r, long n)
+{
+	r->got += n;
+	if(r->left >= 0 && (r->left -= n) <= 0)
+	{
+		r->left = 0;
+		r->state = RESP_DONE;
+	}
+}
+
+int Resp_eof(Resp* r)
+{
+	if(r->state == RESP_BODY && r->left < 0)
+		r->state = RESP_DONE;
+	return r->state == RESP_DONE;
+}
+
+/*
+ * Resp_framed - buf holds the first n bytes of a response as Resp_decode
+ * gives it: 1 if the head is all there and says where the body ends. A
+ * decoded head has no Transfer-Encoding, so that takes a Content-Length
+ * or a status without a body.
+ */
+int Resp_framed(char* buf, int n)
+{
+	char head[RESP_HEAD_MAX + 1];
+	char* line, *end;
+	int status;
+
+	if(n > RESP_HEAD_MAX)
+		n = RESP_HEAD_MAX;
+	memcpy(head, buf, n);
+	head[n] = '\0';
+	if(sscanf(head, "HTTP/1.%*d %d", &status) != 1)
+		return 0;
+	if(status == 204 || status == 304)
+		return 1;
+	for(line = head; (end = strchr(line, '\n')) != NULL; line = end + 1)
+	{
+		if(end == line || (end == line + 1 && line[0] == '\r')) // the empty line
+			return 0;
+		if(is_header(line, "Content-Length"))
+			return 1;
+	}
+	return 0;
+}
+
+static unsigned pool_hash(char* host, int port)
+{
+	unsigned h = 2166136261u;
+	while(*host)
+		h = (h ^ (unsigned char)*host++) * 16777619u;
+	return ((h ^ port) * 16777619u) & (POOL_BUCKETS - 1);
+}
+
+/* pool_unlink - take p out of the pool, pool_lock held */
+static void pool_unlink(Idle* p)
+{
+	Idle** pp;
+
+	for(pp = &bucket[pool_hash(p->host, p->port)]; *pp != p; pp = &(*pp)->h_next)
+		;
+	*pp = p->h_next;
+	p->prev->next = p->next;
+	p->next->prev = p->prev;
+	n_idle--;
+}
+
+static void pool_drop(Idle* p)
+{
+	pool_unlink(p);
+	Close(p->fd);
+	Free(p->host);
+	Free(p);
+}
+
+/* is_header - line is a name field */
+static int is_header(char* line, char* name)
+{
+	int n = strlen(name);
+	return !strncasecmp(line, name, n) && line[n] == ':';
+}
+
+/* has_token - the n bytes of line mention token, in any case */
+static int has_token(char* line, int n, char* token)
+{
+	char buf[MAXLINE];
+
+	if(n > MAXLINE - 1)
+		n = MAXLINE - 1;
+	memcpy(buf, line, n);
+	buf[n] = '\0';
+	return strcasestr(buf, token) != NULL;
+}
+
+/*
+ * head_done - the head is in: rebuild it into out without the hop-by-hop
+ * fields and see how the body is framed. Bytes of out, -1 if bad.
+ */
+static int head_done(Resp* r, char* out)
+{
+	char* line, *end, *p, *length_line = NULL;
+	int len = 0, n, minor, status, length_n = 0;
+	int chunked = 0, close = 0, keep_alive = 0;
+	long length = -1;
+
+	r->head[r->head_len] = '\0';
+	if(sscanf(r->head, "HTTP/1.%d %d", &minor, &status) != 2)
+		return -1;
+	if(status / 100 == 1) // interim, the real response follows
+	{
+		r->head_len = 0;
+		return 0;
+	}
+	for(line = r->head; ; line = end)
+	{
+		end = strchr(line, '\n') + 1;
+		n = end - line;
+		if(n == 1 || (n == 2 && line[0] == '\r')) // the empty line
+			break;
+		if(line == r->head) // status line
+		{
+			if((p = memchr(line, ' ', n)) == NULL)
+				return -1;
+			len += sprintf(out, "HTTP/1.1");
+			memcpy(out + len, p, end - p);
+			len += end - p;
+		}
+		else if(is_header(line, "Connection"))
+		{
+			close |= has_token(line, n, "close");
+			keep_alive |= has_token(line, n, "keep-alive");
+		}
+		else if(is_header(line, "Transfer-Encoding"))
+			chunked = has_token(line, n, "chunked");
+		else if(is_header(line, "Content-Length"))
+		{
+			if((length = strtol(line + strlen("Content-Length:"), NULL, 10)) < 0)
+				return -1;
+			length_line = line;
+			length_n = n;
+		}
+		else if(!is_header(line, "Keep-Alive") && !is_header(line, "Proxy-Connection") &&
+		        !is_header(line, "TE") && !is_header(line, "Trailer") && !is_header(line, "Upgrade"))
+		{
+			memcpy(out + len, line, n);
+			len += n;
+		}
+	}
+	if(length_line != NULL && !chunked) // chunked wins over a length
+	{
+		memcpy(out + len, length_line, length_n);
+		len += length_n;
+	}
+	len += sprintf(out + len, "\r\n");
+
+	r->keep = minor >= 1 ? !close : keep_alive;
+	if(status == 204 || status == 304)
+		r->state = RESP_DONE;
+	else if(chunked)
+		r->state = RESP_SIZE;
+	else if(length >= 0)
+	{
+		r->left = length;
+		r->state = length == 0 ? RESP_DONE : RESP_BODY;
+	}
+	else // up to the close
+	{
+		r->keep = 0;
+		r->state = RESP_BODY;
+	}
+	return len;
+}
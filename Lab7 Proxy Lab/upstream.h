@@ -0,0 +1,57 @@
+#ifndef __UPSTREAM_H__
+#define __UPSTREAM_H__
+
+#include "csapp.h"
+
+#define POOL_MAX 64 // idle connections kept, over all servers
+#define POOL_IDLE 30 // seconds an idle connection is kept
+#define POOL_BUCKETS 64
+
+/*
+ * the pool: connections to servers left open after a response, keyed by
+ * host and port, so that the next miss on the server skips the connect.
+ * Idle connections are kept most recently used first; the oldest goes
+ * when the pool is full or POOL_IDLE has passed. A server may still
+ * close one at any time, so a request that gets nothing back on a
+ * pooled connection is sent again on a new one.
+ */
+int Pool_get(char* host, int port); // an idle connection to host:port, -1 if none
+void Pool_put(char* host, int port, int fd); // fd is idle, the response on it read to the end
+
+#define RESP_HEAD_MAX MAXBUF // a response head, with the empty line
+
+#define RESP_HEAD 0 // reading the head
+#define RESP_BODY 1 // left bytes of the body to come, or up to EOF if left < 0
+#define RESP_SIZE 2 // chunked: reading a chunk-size line
+#define RESP_DATA 3 // chunked: left bytes of the chunk to come
+#define RESP_DATA_END 4 // chunked: the CRLF after a chunk
+#define RESP_TRAILER 5 // chunked: trailer lines, up to an empty one
+#define RESP_DONE 6
+
+/*
+ * a response from the server, decoded as it is read: the head is rebuilt
+ * with the proxy's own HTTP version and without the hop-by-hop headers,
+ * whose job ends at the proxy, and a chunked body comes out as the bare
+ * bytes, delimited by the close. What comes out is what the client and
+ * the cache get. It also tells where the response ends, so the
+ * connection can go back to the pool.
+ */
+typedef struct Resp{
+	int state;
+	char head[RESP_HEAD_MAX]; // RESP_HEAD: what came in so far
+	int head_len;
+	long left;
+	char line[32]; // chunk-size line, past 31 bytes only extensions are dropped
+	int line_len;
+	int keep; // the server keeps the connection open after the response
+	long got; // bytes read from the server
+}Resp;
+
+void Resp_init(Resp* r);
+int Resp_decode(Resp* r, char* in, int n, char* out); // bytes of out, -1 on a bad response; out has room for n + RESP_HEAD_MAX
+int Resp_plain(Resp* r); // the rest of the body is passed on as it is, so it may be spliced
+void Resp_skip(Resp* r, long n); // n bytes of the plain body went past the decoder
+int Resp_eof(Resp* r); // the server closed: 1 if that ends the response
+int Resp_framed(char* buf, int n); // the decoded response at buf tells where it ends, so the client connection can carry on
+
+#endif /* __UPSTREAM_H__ */
@@ -1,178 +1,233 @@
+#define _GNU_SOURCE // splice
 #include <stdio.h>
 #include <stdlib.h>
+#include <poll.h>
 #include "csapp.h"
 #include "cache.h"
+#include "proxy.h"
+#include "sbuf.h"
+#include "upstream.h"
 
-#define MAX_CACHE_SIZE 1049000
-#define MAX_OBJECT_SIZE 102400
+#define NTHREADS 16 // workers of the -t front end
+#define SBUFSIZE 64 // accepted connections waiting for a worker
+#define WORKER_IDLE 1 // seconds a kept connection may hold a -t worker between requests
 
 sem_t mutex;
-extern sem_t w_mutex; 
-extern sem_t cnt_mutex;
-extern sem_t mtime_mutex;
-
-typedef struct main_args{
-	Cache* p_Cache;
-	int connfd;	
-}main_args;
+sbuf_t sbuf; // connected descriptors, from main to the workers
 
 /* function prototypes */
-void doit(int, struct Cache*);
-void clienterror(int, char*, char*, char*, char*);
-void parse_url(char*, char*, char*, char*)__attribute__((always_inline));
-void parse_build_requesthead(rio_t*, char*);
+int doit(int, rio_t*, struct Cache*);
+int follow(int, Cache_fill*, Fill_sub*);
 void* thread(void*);
 int Rio_writen_my(int, void*, size_t);  // Wrapper function to deal with broken pipe(caused by Rio_writen) error
-int Rio_readnb_my(rio_t*, void*, size_t) ; // Wraper function to deal with reset by peer(cause by Rio_readnb) error
-struct hostent *Gethostbyname_my(const char*);// thread-safe Wrapper function
+int Read_my(int, void*, size_t); // read whatever is there, retrying on EINTR
+long splice_all(int, int, long);
+int open_server(char*, int, int, char*, char*, int, int*);
 int open_clientfd_my(char*, int);
 int Open_clientfd_my(char*, int, int); // thread-safe Wrapper function
+int header_add(char*, int*, char*, ...); // bounded append for parse_build_requesthead
+int client_next(rio_t*);
 
 //void sig_int(int);
 
 
 int main(int argc, char* argv[])
 {
-	int listenfd,  port;
+	int listenfd,  port, i;
 	socklen_t clientlen;
 	struct sockaddr_in clientaddr;
 	pthread_t tid;
 
-	if(argc != 2)
+	if(argc != 2 && !(argc == 3 && !strcmp(argv[2], "-t")))
 	{
-		fprintf(stderr, "Usage: %s <port>\n",argv[0]);
+		fprintf(stderr, "Usage: %s <port> [-t]\n",argv[0]);
 		exit(1);
 	}
 
 	Signal(SIGPIPE, SIG_IGN);
 //	Signal(SIGINT,sig_int);
 
-	/* construct and initialize header of cache linked list */
-	
-	Cache* p_Cache = Malloc(sizeof(struct Cache));
-	p_Cache->obj_size = 0;
-	p_Cache->last_access = 0;
-	p_Cache->p_url = NULL;
-	p_Cache->p_next = NULL;
-	p_Cache->response_body = NULL;
+	/* construct and initialize the cache: hash table plus LRU list */
+	Cache* p_Cache = Cache_init();
 
 	Sem_init(&mutex,0,1);
-	Sem_init(&w_mutex,0,1);
-	Sem_init(&cnt_mutex,0,1);
-	Sem_init(&mtime_mutex,0,1);
 
 	port = atoi(argv[1]);
+	if(argc == 2)
+		Event_loops(port, p_Cache); // epoll loops, never returns
+
+	/* -t: a pool of worker threads, blocking I/O throughout */
 	clientlen = sizeof(clientaddr);
 	
 	listenfd = Open_listenfd(port);
 
-	main_args* p_arg;
-	while(1)
-	{
-		p_arg = Malloc(sizeof(struct main_args));
-		(*p_arg).p_Cache = p_Cache;
-		(*p_arg).connfd = Accept(listenfd, (SA*)&clientaddr, &clientlen);
-		Pthread_create(&tid, NULL, thread, (void*)p_arg);
-	}
+	sbuf_init(&sbuf, SBUFSIZE);
+	for(i = 0; i < NTHREADS; i++)
+		Pthread_create(&tid, NULL, thread, (void*)p_Cache);
+	while(1) // once the queue is full, stop accepting and let the listen backlog fill
+		sbuf_insert(&sbuf, Accept(listenfd, (SA*)&clientaddr, &clientlen));
     return 0;
 }
 
+/*
+ * thread - a worker: serve connections from sbuf, one at a time, forever.
+ * A connection is served request after request until the client closes
+ * it, asks to, or goes quiet: for WORKER_IDLE seconds between requests,
+ * CLIENT_IDLE within one. An idle client holds its worker all that time,
+ * so with NTHREADS of them new connections wait in sbuf; the short wait
+ * between requests keeps that to a second, where event.c, which holds
+ * nothing but a descriptor, keeps idle clients for CLIENT_IDLE.
+ */
 void* thread(void* arg)
 {
 	Pthread_detach(Pthread_self());
-	int connfd = (*(struct main_args*)arg).connfd;
-	Cache* p_Cache = (*(struct main_args*)arg).p_Cache;
-	Free(arg);
-	doit(connfd, p_Cache);
-	Close(connfd);
+	Cache* p_Cache = (Cache*)arg;
+	struct timeval idle = { CLIENT_IDLE, 0 };
+	rio_t rio; // pipelined requests wait in its buffer
+	int connfd;
+	while(1)
+	{
+		connfd = sbuf_remove(&sbuf);
+		if(setsockopt(connfd, SOL_SOCKET, SO_RCVTIMEO, &idle, sizeof(idle)) < 0)
+			fprintf(stderr, "setsockopt error: %s\n",strerror(errno));
+		Rio_readinitb(&rio, connfd);
+		while(doit(connfd, &rio, p_Cache) && client_next(&rio))
+			;
+		Close(connfd);
+	}
 	return NULL;
 }
 
-void doit(int fd, Cache* p_Cache)
+/* doit - serve the next request on fd; 1 if the connection carries on after it */
+int doit(int fd, rio_t* p_rio, Cache* p_Cache)
 {
-	rio_t rio;
 	/* proxy receives:  GET http://www.cmu.edu:8080/hub/index.html HTTP/1.1  */
-	char buf[MAXLINE], method[10], url[MAXLINE], uri[MAXLINE], host[MAXLINE], response[MAXBUF];
+	char buf[MAXLINE], method[10], url[MAXLINE], uri[MAXLINE], host[MAXLINE], client_version[MAXLINE] = "";
 	/* proxy should send:  GET /hub/index.html HTTP/1.0  to server's 8080 port */
 	char request_line[MAXLINE] = ""; //request_line built by proxy that will be sent to server
 	char request_header[MAXLINE] = ""; // header bulit by proxy that will be sent to server
 	char request_port[10] = ""; // client assigns a port
-	char version[] = "HTTP/1.0";
-	char save_buf[MAX_OBJECT_SIZE + 1] = ""; // save temp_data from server, no bigger than MAX_OBJ_SIZE
+	char version[] = "HTTP/1.1";
+	char relay_buf[MAXBUF]; // response from server
+	char out_buf[MAXBUF + RESP_HEAD_MAX]; // decoded, on its way to client
 	int clientfd, port;
-	int read_size;
-	Cache* p_is_hit; // if hit cache, this pointer holds the addrress of cache_block; if not hit, return NULL
-	Rio_readinitb(&rio, fd);
-	if(rio_readlineb(&rio, buf, MAXLINE) < 0) // read request line
+	int read_size, out_size, n;
+	long space, spliced;
+	int leader, client_gone, reused, rc;
+	int keep; // the client wants the connection kept
+	int framed = -1; // the response says where it ends, so the connection can carry on; -1 until its head is out
+	Resp resp; // where the response ends, and whether clientfd can go back to the pool
+	Cache_obj* p_is_hit; // if hit cache, this pointer holds the addrress of cache_block; if not hit, return NULL
+	Cache_fill* p_fill; // the response on its way to the cache and to clients following, NULL once nobody needs it
+	Fill_sub sub; // p_fill wakes no one, this thread waits on it
+	sub.wake = NULL;
+	if((rc = rio_readlineb(p_rio, buf, MAXLINE)) <= 0) // read request line; none when the client is done or idle too long
 	{
-		fprintf(stderr, "rio_readlineb error: %s\n",strerror(errno));
-		return;
+		if(rc < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+			fprintf(stderr, "rio_readlineb error: %s\n",strerror(errno));
+		return 0;
 	}
-	sscanf(buf, "%s %s",method, url);
+	sscanf(buf, "%s %s %s",method, url, client_version);
 
 	if(strcasecmp(method, "GET"))
 	{
 		clienterror(fd,method, "501", "Not Implemented","Proxy doesn't implement this request type");
-		Close(fd);
-		Pthread_exit(NULL);
+		return 0; // the worker closes fd and goes on with the next connection
 	}
 	parse_url(url, request_port, host, uri);
 	port = !strlen(request_port) ? 80 : atoi(request_port);
-	sprintf(url,"%s:%d%s", host, port, uri); // rebuild url, using url as a key to search cache
+	if(snprintf(url, sizeof(url), "%s:%d%s", host, port, uri) >= (int)sizeof(url)) // rebuild url, using url as a key to search cache
+	{
+		clienterror(fd, method, "414", "URI Too Long", "Proxy can't handle a url this long");
+		return 0;
+	}
 //	fprintf(stderr, "url: %s\n",url);	
-	if( Search_and_Transfer(url, p_Cache,fd,(void**)&p_is_hit) < 0)
-		return;
-	if(p_is_hit == NULL) // if not hit cache, proxy connect to server, receive and build cache block
+	/* proxy get and parse request head from client and build header for the server; read on a hit too, the next request follows it */
+	if((rc = parse_build_requesthead(p_rio, request_header, host, port)) < 0)
+		return 0; // the head was cut short or too long: close this connection only
+	keep = !rc && !strcmp(client_version, "HTTP/1.1");
+	/* on a miss, fetch the object, or follow the client already fetching it */
+	do{
+		rc = Search_and_Transfer(url, p_Cache,fd,(void**)&p_is_hit);
+		if(p_is_hit != NULL)
+		{
+			framed = Resp_framed(p_is_hit->response_body, p_is_hit->obj_size);
+			Cache_release(p_is_hit);
+			return rc == 0 && keep && framed;
+		}
+	}while((p_fill = Fill_join(p_Cache, url, &sub, &leader)) == NULL);
+	if(!leader)
+		return follow(fd, p_fill, &sub) && keep;
+	else // if not hit cache, proxy connect to server, receive and build cache block
 	{
 		fprintf(stderr ,"miss\n");
 		sprintf(request_line, "%s %s %s\r\n", method, uri, version); // build request line
-		parse_build_requesthead(&rio, request_header); // proxy get and parse request head from client and build header for the server
-		if((clientfd = Open_clientfd_my(host, port, fd)) < 0)
-			return;
-
-		printf("%s: %d", host, port);
-
 		/* ʦ? */
-		if(Rio_writen_my(clientfd, request_line, strlen(request_line)) < 0) // proxy send request-line to server
+		if((clientfd = open_server(host, port, fd, request_line, request_header, 1, &reused)) < 0)
 		{
-			Close(clientfd);
-			return;
-		}
-		if(Rio_writen_my(clientfd, request_header, strlen(request_header)) < 0)// proxy send request-header to server
-		{
-			Close(clientfd);
-			return;
+			Fill_end(p_Cache, p_fill, 0);
+			return 0;
 		}
+
+		printf("%s: %d", host, port);
 	
-		Rio_readinitb(&rio, clientfd);
-		/* get server's response and save in save_buf temporarily */
-//		int total_size = 0;
-		if((read_size = Rio_readnb_my(&rio, response, MAXBUF)) > 0)
+		/* relay the response as it arrives and tee it into the fill, for the cache and for clients following */
+		Resp_init(&resp);
+		client_gone = 0;
+		while(resp.state != RESP_DONE)
 		{
-			if(read_size <= MAX_OBJECT_SIZE) // object should be cached and send back to client
+			n = MAXBUF;
+			if(p_fill != NULL && (space = Fill_space(p_fill, &sub)) < n) // waits for the slowest follower
+				n = space;
+			if((read_size = Read_my(clientfd, relay_buf, n)) <= 0)
 			{
-				fprintf(stderr, "should add cache!\n");
-				if(Rio_writen_my(fd, save_buf, read_size) < 0) // sent back to client
+				if(resp.got > 0 || !reused)
 				{
-					Close(clientfd);
-					return;
+					if(resp.state == RESP_HEAD && !client_gone) // the server went away before the head: nothing sent yet
+						clienterror(fd, host, "502", "Bad Gateway", "Proxy got no response");
+					break;
 				}
-				Write_and_Update(p_Cache, read_size, url, save_buf); // write to cache and update access time
+				Close(clientfd); // the server closed it while it sat in the pool: once more on a new one
+				if((clientfd = open_server(host, port, fd, request_line, request_header, 0, &reused)) < 0)
+					break;
+				continue;
+			}
+			if((out_size = Resp_decode(&resp, relay_buf, read_size, out_buf)) < 0)
+			{
+				fprintf(stderr, "bad response from %s\n", host);
+				if(resp.state == RESP_HEAD && !client_gone) // nothing sent yet
+					clienterror(fd, host, "502", "Bad Gateway", "Proxy got a bad response");
+				break;
+			}
+			if(framed < 0 && out_size > 0) // the head comes out all at once
+				framed = Resp_framed(out_buf, out_size);
+			if(!client_gone && Rio_writen_my(fd, out_buf, out_size) < 0)
+			{
+				client_gone = 1;
+				if(p_fill == NULL || !Fill_shared(p_fill))
+					break;
+				// go on for the clients following
 			}
-			else // should not cache, transfer it to client directly
+			if(p_fill != NULL && Fill_append(p_fill, out_buf, out_size) < 0) // should not cache, and nobody follows
 			{
 				fprintf(stderr, "shouldn't cache!\n");
-				if(Rio_writen_my(fd, save_buf, read_size) < 0)
-				{
-					Close(clientfd);
-					return;
-				}
-				while((read_size = Rio_readnb_my(&rio, save_buf, MAX_OBJECT_SIZE+1)) > 0)
-					if(Rio_writen_my(fd, save_buf, read_size) < 0)
-						break;
+				Fill_end(p_Cache, p_fill, 0);
+				p_fill = NULL;
+				if(client_gone)
+					break;
+				if(Resp_plain(&resp) && (spliced = splice_all(clientfd, fd, resp.left)) >= 0) // the rest through a pipe, never copied out of the kernel
+					Resp_skip(&resp, spliced);
 			}
 		}
-		Close(clientfd);
+		if(read_size == 0)
+			Resp_eof(&resp);
+		if(p_fill != NULL)
+			Fill_end(p_Cache, p_fill, resp.state == RESP_DONE); // the whole response: write to cache if it fits and update access time
+		if(clientfd >= 0 && resp.state == RESP_DONE && resp.keep)
+			Pool_put(host, port, clientfd); // for the next miss on the server
+		else if(clientfd >= 0)
+			Close(clientfd);
+		return keep && framed == 1 && resp.state == RESP_DONE && !client_gone;
 	}
 //	else
 //		Rio_writen_my(fd, p_is_hit->response_body, p_is_hit->obj_size);
@@ -180,6 +235,28 @@ void doit(int fd, Cache* p_Cache)
 }
 
 
+/*
+ * follow - send fd the response another client's thread is fetching, as
+ * it comes in; 1 if all of it went out and it says where it ends
+ */
+int follow(int fd, Cache_fill* p_fill, Fill_sub* p_sub)
+{
+	char relay_buf[MAXBUF];
+	int read_size, framed = 0;
+	while((read_size = Fill_read(p_fill, p_sub, relay_buf, MAXBUF)) > 0)
+	{
+		if(p_sub->off == read_size) // the head comes first, all at once
+			framed = Resp_framed(relay_buf, read_size);
+		if(Rio_writen_my(fd, relay_buf, read_size) < 0)
+			break;
+	}
+	if(read_size < 0 && p_sub->off == 0) // the fetch failed before anything came
+		clienterror(fd, p_fill->p_url, "502", "Bad Gateway", "Proxy couldn't fetch the object");
+	Fill_leave(p_fill, p_sub);
+	return read_size == 0 && framed;
+}
+
+
 /* parse_url parses sth like http://www.cmu.edu:8080/hub/index.html ; and fills the results in host[] and uri[]*/
 __attribute__((always_inline))
 void parse_url(char* url, char* p_port, char* host, char* uri)
@@ -217,15 +294,36 @@ void parse_url(char* url, char* p_port, char* host, char* uri)
 }
 
 
-/* proxy parses client's request header and build header to be sent to server */
-void parse_build_requesthead(rio_t* rp, char* header)
+/* client_next - 1 once the next request is on its way, 0 if the client sent nothing for WORKER_IDLE */
+int client_next(rio_t* rp)
+{
+	struct pollfd pfd = { .fd = rp->rio_fd, .events = POLLIN };
+	int rc;
+
+	if(rp->rio_cnt > 0) // pipelined, already read
+		return 1;
+	while((rc = poll(&pfd, 1, WORKER_IDLE * 1000)) < 0 && errno == EINTR)
+		;
+	return rc > 0;
+}
+
+/*
+ * proxy parses client's request header and build header to be sent to server.
+ * The request goes out as HTTP/1.1 on a connection that may be kept in
+ * the pool, so the client's hop-by-hop fields are dropped and Host is
+ * added if the client left it out. header has room for MAXLINE bytes.
+ * Returns 1 if they asked the proxy to close the client connection after
+ * the response, -1 if the head does not fit in header or the client
+ * went away, or went quiet, before its end.
+ */
+int parse_build_requesthead(rio_t* rp, char* header, char* host, int port)
 {
 	//char* ptr;
 	char buf[MAXLINE];
-	Rio_readlineb(rp, buf, MAXLINE);
-	int ua = 0, ac = 0, ae = 0, co = 0, pc = 0;
+	int ua = 0, ac = 0, ae = 0, ho = 0, close = 0, len = 0, rc;
 
-	while(strcmp(buf, "\r\n") && strcmp(buf, "\n"))
+	header[0] = '\0';
+	while((rc = rio_readlineb(rp, buf, MAXLINE)) > 0 && strcmp(buf, "\r\n") && strcmp(buf, "\n"))
 	{
 		/*
 		if((ptr = strstr(buf, ":")) == NULL)
@@ -236,53 +334,67 @@ void parse_build_requesthead(rio_t* rp, char* header)
 		*ptr = '\0';
 		*/
 		if(strstr(buf, "User-Agent")){
-			sprintf(header, "%sUser-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:10.0.3) Gecko/20120305 Firefox/10.0.3\r\n",header);
+			rc = header_add(header, &len, "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:10.0.3) Gecko/20120305 Firefox/10.0.3\r\n");
 			ua = 1;
 		}
 		else if(strstr(buf, "Accept")){
-			sprintf(header, "%sAccept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n",header);
+			rc = header_add(header, &len, "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n");
 			ac = 1;
 		}
 		else if(strstr(buf, "Accept-Encoding")){
-			sprintf(header, "%sAccept-Encoding: gzip, deflate\r\n",header);
+			rc = header_add(header, &len, "Accept-Encoding: gzip, deflate\r\n");
 			ae = 1;
 		}
-		else if(strstr(buf, "Connection")){
-			sprintf(header, "%sConnection: close\r\n",header);
-			co = 1;
-		}
-		else if(strstr(buf, "Proxy-Connection")){
-			sprintf(header, "%sProxy-Connection: close\r\n",header);
-			pc = 1;
+		else if(strstr(buf, "Connection") || !strncasecmp(buf, "Keep-Alive:", 11) ||
+		        !strncasecmp(buf, "TE:", 3) || !strncasecmp(buf, "Upgrade:", 8)){
+			if(strstr(buf, "Connection") && strcasestr(buf, "close"))
+				close = 1; // between the client and the proxy only
 		}
 		else
 		{
+			if(!strncasecmp(buf, "Host:", 5))
+				ho = 1;
 			//*ptr = ':';  other request headers, proxy forward them unchanged
-			sprintf(header, "%s%s", header,buf);
+			rc = header_add(header, &len, "%s", buf);
 		}
-		Rio_readlineb(rp, buf, MAXLINE);
-	}
-
-	if(!ua){
-		sprintf(header, "%sUser-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:10.0.3) Gecko/20120305 Firefox/10.0.3\r\n",header);
+		if(rc < 0)
+			return -1;
 	}
-
-	if(!ac){
-		sprintf(header, "%sAccept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n",header);
+	if(rc <= 0) // EOF, an error, or CLIENT_IDLE passed, before the empty line
+	{
+		if(rc < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+			fprintf(stderr, "rio_readlineb error: %s\n",strerror(errno));
+		return -1;
 	}
 
-	if(!ae){
-		sprintf(header, "%sAccept-Encoding: gzip, deflate\r\n",header);
-	}
+	if(!ua && header_add(header, &len, "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:10.0.3) Gecko/20120305 Firefox/10.0.3\r\n") < 0)
+		return -1;
+	if(!ac && header_add(header, &len, "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n") < 0)
+		return -1;
+	if(!ae && header_add(header, &len, "Accept-Encoding: gzip, deflate\r\n") < 0)
+		return -1;
+	if(!ho && port == 80 && header_add(header, &len, "Host: %s\r\n", host) < 0)
+		return -1;
+	if(!ho && port != 80 && header_add(header, &len, "Host: %s:%d\r\n", host, port) < 0)
+		return -1;
+	if(header_add(header, &len, "\r\n") < 0)
+		return -1;
+	return close;
+}
 
-	if(!co){
-		sprintf(header, "%sConnection: close\r\n",header);
-	}
+/* header_add - append to the len bytes of header, MAXLINE in all; -1 if it does not fit */
+int header_add(char* header, int* p_len, char* fmt, ...)
+{
+	va_list ap;
+	int n;
 
-	if(!pc){
-		sprintf(header, "%sProxy-Connection: close\r\n",header);
-	}
-	sprintf(header, "%s\r\n", header);
+	va_start(ap, fmt);
+	n = vsnprintf(header + *p_len, MAXLINE - *p_len, fmt, ap);
+	va_end(ap);
+	if(n < 0 || n >= MAXLINE - *p_len)
+		return -1;
+	*p_len += n;
+	return 0;
 }
 
 
@@ -309,14 +421,13 @@ void clienterror(int fd, char *cause, char *errnum,
     if(Rio_writen_my(fd, body, strlen(body)) < 0) return;
 }
 
-int Rio_readnb_my(rio_t *rp, void *usrbuf, size_t n) 
+int Read_my(int fd, void *usrbuf, size_t n)
 {
 	int rc;
-	if((rc = rio_readnb(rp, usrbuf, n)) < 0)
-	{
-		fprintf(stderr, "Rio_readnb_my error: %s\n",strerror(errno));
-		return -1;
-	}
+	while((rc = read(fd, usrbuf, n)) < 0 && errno == EINTR)
+		;
+	if(rc < 0)
+		fprintf(stderr, "Read_my error: %s\n",strerror(errno));
 	return rc;
 }
 
@@ -332,6 +443,57 @@ int Rio_writen_my(int fd, void *usrbuf, size_t n)
 }
 
 
+/*
+ * splice_all - move len bytes, or everything up to EOF if len < 0, from
+ * from to to through a pipe. Bytes moved; -1 if there is no pipe to be had.
+ */
+long splice_all(int from, int to, long len)
+{
+	int p[2];
+	ssize_t n = 0, m = 0; // len may be 0: nothing is spliced
+	long moved = 0;
+	if(pipe(p) < 0)
+	{
+		fprintf(stderr, "splice_all error: %s\n",strerror(errno));
+		return -1;
+	}
+	while(moved != len && (n = splice(from, NULL, p[1], NULL, len < 0 || len - moved > 65536 ? 65536 : len - moved, SPLICE_F_MOVE)) > 0)
+	{
+		for(moved += n; n > 0; n -= m)
+			if((m = splice(p[0], NULL, to, NULL, n, SPLICE_F_MOVE)) <= 0)
+				break;
+		if(n > 0)
+			break;
+	}
+	if(n < 0 || m < 0)
+		fprintf(stderr, "splice_all error: %s\n",strerror(errno));
+	Close(p[0]);
+	Close(p[1]);
+	return moved;
+}
+
+/*
+ * open_server - a connection to host:port with the request sent on it:
+ * an idle one from the pool if pooled is set and there is one, else a
+ * new one; *p_reused tells which. -1 on failure.
+ */
+int open_server(char* host, int port, int fd, char* line, char* header, int pooled, int* p_reused)
+{
+	int serverfd = -1;
+	*p_reused = pooled && (serverfd = Pool_get(host, port)) >= 0;
+	while(1)
+	{
+		if(!*p_reused && (serverfd = Open_clientfd_my(host, port, fd)) < 0)
+			return -1;
+		if(Rio_writen_my(serverfd, line, strlen(line)) == 0 && Rio_writen_my(serverfd, header, strlen(header)) == 0)
+			return serverfd;
+		Close(serverfd);
+		if(!*p_reused)
+			return -1;
+		*p_reused = 0; // closed while it sat in the pool
+	}
+}
+
 int Open_clientfd_my(char* hostname, int port, int fd)
 {
 	int rc;